@@ -0,0 +1,675 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BATCH_AVX2
+#endif
+
+#include "batch.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define BATCH_VECTOR 32 // Lanes per AVX2 vector
+
+// Types
+/*
+ * Registers are stored lane-wise, one array per register, padded to whole
+ * vectors. Everything else stays in one machine per lane, whose registers
+ * are only current while that lane runs on its own through emulate_instruction.
+*/
+struct batch {
+    uint32_t lanes;
+    uint32_t width;
+    chip8_t *machines;
+
+    uint8_t *V[16];
+    uint8_t *DT;
+    uint8_t *ST;
+    uint16_t *PC;
+    uint16_t *I;
+
+    // Memory written since each lane's last reset; code outside it is the boot image
+    uint32_t *dirty_start;
+    uint32_t *dirty_end;
+    uint8_t *written; // 0xFF for lanes with any memory written
+    bool same_boot;
+
+    // Current step
+    uint8_t *mask;   // 0xFF for lanes in the group being run
+    uint8_t *done;   // Lanes that already ran this step
+    uint32_t *ahead; // Steps each lane ran ahead on its own, and sits out
+    uint32_t behind; // Lanes with steps to sit out
+
+    void *registers;
+    batch_stats_t stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                    LANES                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Copy a lane's registers into its machine
+ * @param batch Batch
+ * @param lane Lane index
+*/
+void load_lane(batch_t *batch, uint32_t lane) {
+    chip8_t *machine = &batch->machines[lane];
+    for (uint32_t r = 0; r < 16; r++) machine->V[r] = batch->V[r][lane];
+    machine->DT = batch->DT[lane];
+    machine->ST = batch->ST[lane];
+    machine->PC = batch->PC[lane];
+    machine->I = batch->I[lane];
+}
+
+/**
+ * Copy a lane's registers back from its machine
+ * @param batch Batch
+ * @param lane Lane index
+*/
+void store_lane(batch_t *batch, uint32_t lane) {
+    const chip8_t *machine = &batch->machines[lane];
+    for (uint32_t r = 0; r < 16; r++) batch->V[r][lane] = machine->V[r];
+    batch->DT[lane] = machine->DT;
+    batch->ST[lane] = machine->ST;
+    batch->PC[lane] = machine->PC;
+    batch->I[lane] = machine->I;
+    batch->dirty_start[lane] = machine->dirty_start;
+    batch->dirty_end[lane] = machine->dirty_end;
+    batch->written[lane] = machine->dirty_start < machine->dirty_end ? 0xFF : 0x00;
+}
+
+/**
+ * Whether an opcode has a lane-wise implementation; anything touching memory,
+ * the stack, the display or the keypad runs lane by lane instead
+ * @param opcode Opcode
+ * @return Whether run_group can run it
+*/
+bool can_vectorize(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x1: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0x9: case 0xA:
+            return true;
+
+        case 0x8: {
+            const uint8_t N = opcode & 0x000F;
+            return N <= 0x7 || N == 0xE;
+        }
+
+        case 0xF: {
+            const uint8_t NN = opcode & 0x00FF;
+            return NN == 0x07 || NN == 0x15 || NN == 0x18 || NN == 0x1E;
+        }
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Fetch an opcode as emulate_instruction does
+ * @param memory Lane memory
+ * @param pc Lane PC
+ * @return Opcode, 0 for odd or out of range PCs, which only run lane by lane
+*/
+uint16_t fetch_opcode(const uint8_t *memory, uint16_t pc) {
+    return pc & 0xF001 ? 0 : (memory[pc] << 8) | memory[pc + 1];
+}
+
+/**
+ * Run a single lane through the interpreter, from an instruction that cannot
+ * run across lanes up to the next one that can; the extra steps it took are
+ * sat out later so every lane runs the same number of instructions
+ * @param batch Batch
+ * @param lane Lane index
+ * @param steps Steps left in the frame, at least 1
+*/
+void run_lane(batch_t *batch, uint32_t lane, uint32_t steps) {
+    chip8_t *machine = &batch->machines[lane];
+    uint32_t ran = 0;
+
+    load_lane(batch, lane);
+    do {
+        emulate_instruction(machine);
+        ran++;
+    } while (ran < steps && !can_vectorize(fetch_opcode(machine->memory, machine->PC)));
+    store_lane(batch, lane);
+
+    batch->ahead[lane] = ran - 1;
+    batch->behind += ran > 1;
+    batch->stats.scalar += ran;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    BATCH                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Create a batch running copies of the given machines as lanes; lanes always
+ * interpret, whatever engine the machines were set up with
+ * @param machines Machines to copy, one per lane
+ * @param lanes Number of lanes
+ * @return Batch, NULL if allocation failed
+*/
+batch_t *create_batch(const chip8_t *machines, uint32_t lanes) {
+    if (lanes == 0) return NULL;
+
+    batch_t *batch = calloc(1, sizeof(batch_t));
+    if (!batch) return NULL;
+
+    batch->lanes = lanes;
+    batch->width = (lanes + BATCH_VECTOR - 1) / BATCH_VECTOR * BATCH_VECTOR;
+
+    // Byte registers, then the written, mask and done flags, then the wider ones
+    const size_t width = batch->width;
+    batch->machines = malloc(lanes * sizeof(chip8_t));
+    batch->registers = calloc(1, width * (16 + 5) + width * 2 * sizeof(uint16_t) + width * 3 * sizeof(uint32_t));
+    if (!batch->machines || !batch->registers) {
+        destroy_batch(batch);
+        return NULL;
+    }
+
+    uint8_t *bytes = batch->registers;
+    for (uint32_t r = 0; r < 16; r++, bytes += width) batch->V[r] = bytes;
+    batch->DT = bytes; bytes += width;
+    batch->ST = bytes; bytes += width;
+    batch->written = bytes; bytes += width;
+    batch->mask = bytes; bytes += width;
+    batch->done = bytes; bytes += width;
+    batch->dirty_start = (uint32_t *)bytes; bytes += width * sizeof(uint32_t);
+    batch->dirty_end = (uint32_t *)bytes; bytes += width * sizeof(uint32_t);
+    batch->ahead = (uint32_t *)bytes; bytes += width * sizeof(uint32_t);
+    batch->PC = (uint16_t *)bytes; bytes += width * sizeof(uint16_t);
+    batch->I = (uint16_t *)bytes;
+
+    // Padding lanes never run
+    memset(batch->done + lanes, 0xFF, width - lanes);
+
+    batch->same_boot = true;
+    for (uint32_t lane = 0; lane < lanes; lane++) {
+        batch->machines[lane] = machines[lane];
+        batch->machines[lane].jit = NULL;
+        batch->same_boot &= memcmp(machines[lane].boot, machines[0].boot, sizeof(machines[0].boot)) == 0;
+        store_lane(batch, lane);
+    }
+
+#ifdef BATCH_AVX2
+    batch->stats.avx2 = __builtin_cpu_supports("avx2");
+#endif
+    return batch;
+}
+
+/**
+ * Free a batch
+ * @param batch Batch
+*/
+void destroy_batch(batch_t *batch) {
+    if (!batch) return;
+
+    free(batch->machines);
+    free(batch->registers);
+    free(batch);
+}
+
+/**
+ * Get a lane's machine, with its registers brought up to date
+ * @param batch Batch
+ * @param lane Lane index
+ * @return Machine; keypad and memory changes carry into the next frame, register changes do not
+*/
+chip8_t *get_batch_lane(batch_t *batch, uint32_t lane) {
+    load_lane(batch, lane);
+    return &batch->machines[lane];
+}
+
+/**
+ * Get how much of the work ran across lanes
+ * @param batch Batch
+ * @param stats Output stats
+*/
+void get_batch_stats(const batch_t *batch, batch_stats_t *stats) {
+    *stats = batch->stats;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  EXECUTION                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Mark the lanes from first on that have yet to run this step, sit at pc and
+ * never wrote memory, if the boot image holds the group's opcode at pc; one
+ * lane at a time
+ * @param batch Batch
+ * @param first First lane to look at
+ * @param pc Group PC
+ * @param boot_match 0xFF if the boot image holds the group's opcode at pc
+ * @param dirty Output, set if a lane at pc wrote memory and was left out
+ * @return Number of lanes marked
+*/
+uint32_t select_clean_scalar(batch_t *batch, uint32_t first, uint16_t pc, uint8_t boot_match, bool *dirty) {
+    uint8_t written = 0;
+    uint32_t count = 0;
+
+    for (uint32_t lane = first; lane < batch->lanes; lane++) {
+        const uint8_t here = (batch->done[lane] == 0) & (batch->PC[lane] == pc) ? 0xFF : 0x00;
+        const uint8_t take = here & ~batch->written[lane] & boot_match;
+
+        batch->mask[lane] = take;
+        batch->done[lane] |= take;
+        count += take & 1;
+        written |= here & batch->written[lane];
+    }
+
+    *dirty = written;
+    return count;
+}
+
+#ifdef BATCH_AVX2
+
+/**
+ * Same as select_clean_scalar, 32 lanes per instruction
+ * @param batch Batch
+ * @param first First lane to look at, a multiple of BATCH_VECTOR
+ * @param pc Group PC
+ * @param boot_match 0xFF if the boot image holds the group's opcode at pc
+ * @param dirty Output, set if a lane at pc wrote memory and was left out
+ * @return Number of lanes marked
+*/
+__attribute__((target("avx2")))
+uint32_t select_clean_avx2(batch_t *batch, uint32_t first, uint16_t pc, uint8_t boot_match, bool *dirty) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pcs = _mm256_set1_epi16((short)pc);
+    const __m256i match = _mm256_set1_epi8((char)boot_match);
+    __m256i written = zero;
+    uint32_t count = 0;
+
+    for (uint32_t lane = first; lane < batch->width; lane += BATCH_VECTOR) {
+        const __m256i lo = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(batch->PC + lane)), pcs);
+        const __m256i hi = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(batch->PC + lane + 16)), pcs);
+        // Packing works within each 128-bit half; put the bytes back in lane order
+        const __m256i at = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+
+        __m256i *done = (__m256i *)(batch->done + lane);
+        const __m256i ready = _mm256_cmpeq_epi8(_mm256_loadu_si256(done), zero);
+        const __m256i here = _mm256_and_si256(at, ready);
+        const __m256i wrote = _mm256_loadu_si256((const __m256i *)(batch->written + lane));
+        const __m256i take = _mm256_and_si256(_mm256_andnot_si256(wrote, here), match);
+
+        _mm256_storeu_si256((__m256i *)(batch->mask + lane), take);
+        _mm256_storeu_si256(done, _mm256_or_si256(_mm256_loadu_si256(done), take));
+        count += __builtin_popcount((uint32_t)_mm256_movemask_epi8(take));
+        written = _mm256_or_si256(written, _mm256_and_si256(here, wrote));
+    }
+
+    *dirty = !_mm256_testz_si256(written, written);
+    return count;
+}
+
+#endif
+
+/**
+ * Mark the lanes that have yet to run this step and hold the same
+ * instruction at the same PC as the group leader
+ * @param batch Batch
+ * @param first First lane to look at; every lane before it already ran this step
+ * @param pc Group PC, even and in range
+ * @param opcode Opcode at pc in the leader's memory
+ * @return Number of lanes in the group
+*/
+uint32_t select_lanes(batch_t *batch, uint32_t first, uint16_t pc, uint16_t opcode) {
+    // Lanes that never wrote memory hold the boot image at pc
+    const uint8_t *boot = batch->machines[0].boot;
+    const uint8_t boot_match = batch->same_boot && ((boot[pc] << 8) | boot[pc + 1]) == opcode ? 0xFF : 0x00;
+    bool dirty;
+
+#ifdef BATCH_AVX2
+    uint32_t count = batch->stats.avx2 ? select_clean_avx2(batch, first, pc, boot_match, &dirty) :
+        select_clean_scalar(batch, first, pc, boot_match, &dirty);
+#else
+    uint32_t count = select_clean_scalar(batch, first, pc, boot_match, &dirty);
+#endif
+    if (!dirty) return count;
+
+    // Lanes that wrote memory still hold the boot image outside what they wrote
+    for (uint32_t lane = first; lane < batch->lanes; lane++) {
+        if (batch->done[lane] || batch->PC[lane] != pc || !batch->written[lane]) continue;
+
+        const uint8_t *memory = batch->machines[lane].memory;
+        const bool clean = pc + 2u <= batch->dirty_start[lane] || pc >= batch->dirty_end[lane];
+        if (clean ? !boot_match : ((memory[pc] << 8) | memory[pc + 1]) != opcode) continue;
+
+        batch->mask[lane] = 0xFF;
+        batch->done[lane] = 0xFF;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Move the selected lanes past an opcode accepted by can_vectorize, taking
+ * jumps and skips and setting I for ANNN; one lane at a time
+ * @param batch Batch
+ * @param first First lane to look at
+ * @param pc Group PC
+ * @param opcode Opcode
+*/
+void run_flow_scalar(batch_t *batch, uint32_t first, uint16_t pc, uint16_t opcode) {
+    const uint8_t NN = opcode & 0x00FF;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t *VX = batch->V[(opcode & 0x0F00) >> 8];
+    const uint8_t *VY = batch->V[(opcode & 0x00F0) >> 4];
+
+    for (uint32_t lane = first; lane < batch->lanes; lane++) {
+        if (!batch->mask[lane]) continue;
+
+        uint16_t next = pc + 2;
+        switch (opcode >> 12) {
+            case 0x1: next = NNN; break;
+            case 0x3: next += VX[lane] == NN ? 2 : 0; break;
+            case 0x4: next += VX[lane] != NN ? 2 : 0; break;
+            case 0x5: next += VX[lane] == VY[lane] ? 2 : 0; break;
+            case 0x9: next += VX[lane] != VY[lane] ? 2 : 0; break;
+            case 0xA: batch->I[lane] = NNN; break;
+        }
+
+        batch->PC[lane] = next;
+    }
+}
+
+#ifdef BATCH_AVX2
+
+/**
+ * Same as run_flow_scalar, 32 lanes per instruction
+ * @param batch Batch
+ * @param first First lane to look at, a multiple of BATCH_VECTOR
+ * @param pc Group PC
+ * @param opcode Opcode
+*/
+__attribute__((target("avx2")))
+void run_flow_avx2(batch_t *batch, uint32_t first, uint16_t pc, uint16_t opcode) {
+    const uint8_t op = opcode >> 12;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t *VX = batch->V[(opcode & 0x0F00) >> 8];
+    const uint8_t *VY = batch->V[(opcode & 0x00F0) >> 4];
+    const bool skip = op == 0x3 || op == 0x4 || op == 0x5 || op == 0x9;
+
+    const __m256i next = _mm256_set1_epi16((short)(op == 0x1 ? NNN : pc + 2));
+    const __m256i nnn = _mm256_set1_epi16((short)NNN);
+    const __m256i nn = _mm256_set1_epi8((char)(opcode & 0x00FF));
+    const __m256i two = _mm256_set1_epi16(2);
+
+    for (uint32_t lane = first; lane < batch->width; lane += BATCH_VECTOR) {
+        const __m256i mask = _mm256_loadu_si256((const __m256i *)(batch->mask + lane));
+        if (_mm256_testz_si256(mask, mask)) continue;
+
+        // Skips are decided on bytes, 0xFF where the lane skips
+        __m256i taken = _mm256_setzero_si256();
+        if (skip) {
+            const __m256i x = _mm256_loadu_si256((const __m256i *)(VX + lane));
+            const __m256i other = op == 0x3 || op == 0x4 ? nn : _mm256_loadu_si256((const __m256i *)(VY + lane));
+            taken = _mm256_cmpeq_epi8(x, other);
+            if (op == 0x4 || op == 0x9) taken = _mm256_xor_si256(taken, _mm256_set1_epi8(-1));
+        }
+
+        // PC and I are words, so each half of the byte masks is widened in turn
+        for (uint32_t half = 0; half < 2; half++) {
+            const __m256i mask16 = _mm256_cvtepi8_epi16(half ? _mm256_extracti128_si256(mask, 1) : _mm256_castsi256_si128(mask));
+            const __m256i taken16 = _mm256_cvtepi8_epi16(half ? _mm256_extracti128_si256(taken, 1) : _mm256_castsi256_si128(taken));
+
+            __m256i *PC = (__m256i *)(batch->PC + lane + half * 16);
+            const __m256i target = _mm256_add_epi16(next, _mm256_and_si256(taken16, two));
+            _mm256_storeu_si256(PC, _mm256_blendv_epi8(_mm256_loadu_si256(PC), target, mask16));
+
+            if (op == 0xA) {
+                __m256i *I = (__m256i *)(batch->I + lane + half * 16);
+                _mm256_storeu_si256(I, _mm256_blendv_epi8(_mm256_loadu_si256(I), nnn, mask16));
+            }
+        }
+    }
+}
+
+#endif
+
+/**
+ * Run a 6XNN, 7XNN or 8XYN opcode on the selected lanes, one lane at a time
+ * @param batch Batch
+ * @param first First lane to look at
+ * @param opcode Opcode
+*/
+void run_alu_scalar(batch_t *batch, uint32_t first, uint16_t opcode) {
+    const uint8_t X = (opcode & 0x0F00) >> 8;
+    const uint8_t Y = (opcode & 0x00F0) >> 4;
+    const uint8_t NN = opcode & 0x00FF;
+    uint8_t *VX = batch->V[X];
+    uint8_t *VY = batch->V[Y];
+    uint8_t *VF = batch->V[0xF];
+    const uint8_t op = opcode >> 12 == 0x8 ? 0x10 | (NN & 0xF) : opcode >> 12;
+
+    // Same statements as the handlers; VX or VY may be VF, which is written first
+    for (uint32_t lane = first; lane < batch->lanes; lane++) {
+        if (!batch->mask[lane]) continue;
+
+        switch (op) {
+            case 0x6: VX[lane] = NN; break;
+            case 0x7: VX[lane] += NN; break;
+            case 0x10: VX[lane] = VY[lane]; break;
+            case 0x11: VX[lane] |= VY[lane]; break;
+            case 0x12: VX[lane] &= VY[lane]; break;
+            case 0x13: VX[lane] ^= VY[lane]; break;
+
+            case 0x14:
+                VF[lane] = VX[lane] + VY[lane] > 0xFF;
+                VX[lane] += VY[lane];
+                break;
+
+            case 0x15:
+                VF[lane] = VX[lane] > VY[lane];
+                VX[lane] -= VY[lane];
+                break;
+
+            case 0x16:
+                VF[lane] = VX[lane] & 0xF;
+                VX[lane] >>= 1;
+                break;
+
+            case 0x17:
+                VF[lane] = VY[lane] > VX[lane];
+                VX[lane] = VY[lane] - VX[lane];
+                break;
+
+            case 0x1E:
+                VF[lane] = VX[lane] >> 7;
+                VX[lane] <<= 1;
+                break;
+        }
+    }
+}
+
+#ifdef BATCH_AVX2
+
+/**
+ * Run a 6XNN, 7XNN or 8XYN opcode on the selected lanes, 32 lanes per
+ * instruction; lanes outside the group are blended back unchanged
+ * @param batch Batch
+ * @param first First lane to look at, a multiple of BATCH_VECTOR
+ * @param opcode Opcode
+*/
+__attribute__((target("avx2")))
+void run_alu_avx2(batch_t *batch, uint32_t first, uint16_t opcode) {
+    const uint8_t X = (opcode & 0x0F00) >> 8;
+    const uint8_t Y = (opcode & 0x00F0) >> 4;
+    const uint8_t NN = opcode & 0x00FF;
+    // 8XYN operations are told apart from 6XNN and 7XNN by 0x10
+    const uint8_t op = opcode >> 12 == 0x8 ? 0x10 | (NN & 0xF) : opcode >> 12;
+
+    const __m256i nn = _mm256_set1_epi8((char)NN);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i sign = _mm256_set1_epi8((char)0x80); // Flips unsigned order into signed order
+
+    for (uint32_t lane = first; lane < batch->width; lane += BATCH_VECTOR) {
+        const __m256i mask = _mm256_loadu_si256((const __m256i *)(batch->mask + lane));
+        if (_mm256_testz_si256(mask, mask)) continue;
+
+        __m256i x = _mm256_loadu_si256((const __m256i *)(batch->V[X] + lane));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(batch->V[Y] + lane));
+
+        // VF is written first, as the handlers do, and the result then reads
+        // it back wherever X or Y is F
+        if (op >= 0x14) {
+            __m256i flag;
+            switch (op) {
+                case 0x14:
+                    // Carry wherever the saturating sum differs from the wrapping one
+                    flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(x, y), _mm256_add_epi8(x, y)), one);
+                    break;
+                case 0x15: flag = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_xor_si256(x, sign), _mm256_xor_si256(y, sign)), one); break;
+                case 0x16: flag = _mm256_and_si256(x, _mm256_set1_epi8(0x0F)); break;
+                case 0x17: flag = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_xor_si256(y, sign), _mm256_xor_si256(x, sign)), one); break;
+                default: flag = _mm256_and_si256(_mm256_srli_epi16(x, 7), one); break;
+            }
+
+            __m256i *vf = (__m256i *)(batch->V[0xF] + lane);
+            _mm256_storeu_si256(vf, _mm256_blendv_epi8(_mm256_loadu_si256(vf), flag, mask));
+            x = _mm256_loadu_si256((const __m256i *)(batch->V[X] + lane));
+            y = _mm256_loadu_si256((const __m256i *)(batch->V[Y] + lane));
+        }
+
+        __m256i result;
+        switch (op) {
+            case 0x6: result = nn; break;
+            case 0x7: result = _mm256_add_epi8(x, nn); break;
+            case 0x10: result = y; break;
+            case 0x11: result = _mm256_or_si256(x, y); break;
+            case 0x12: result = _mm256_and_si256(x, y); break;
+            case 0x13: result = _mm256_xor_si256(x, y); break;
+            case 0x14: result = _mm256_add_epi8(x, y); break;
+            case 0x15: result = _mm256_sub_epi8(x, y); break;
+            // No byte shifts; shift words and drop the bit from the neighbouring byte
+            case 0x16: result = _mm256_and_si256(_mm256_srli_epi16(x, 1), _mm256_set1_epi8(0x7F)); break;
+            case 0x17: result = _mm256_sub_epi8(y, x); break;
+            default: result = _mm256_add_epi8(x, x); break;
+        }
+
+        __m256i *vx = (__m256i *)(batch->V[X] + lane);
+        _mm256_storeu_si256(vx, _mm256_blendv_epi8(_mm256_loadu_si256(vx), result, mask));
+    }
+}
+
+#endif
+
+/**
+ * Run an opcode accepted by can_vectorize on the selected lanes
+ * @param batch Batch
+ * @param first First lane to look at, a multiple of BATCH_VECTOR
+ * @param pc Group PC
+ * @param opcode Opcode
+*/
+void run_group(batch_t *batch, uint32_t first, uint16_t pc, uint16_t opcode) {
+    const uint8_t NN = opcode & 0x00FF;
+    uint8_t *VX = batch->V[(opcode & 0x0F00) >> 8];
+
+#ifdef BATCH_AVX2
+    if (batch->stats.avx2) run_flow_avx2(batch, first, pc, opcode);
+    else run_flow_scalar(batch, first, pc, opcode);
+#else
+    run_flow_scalar(batch, first, pc, opcode);
+#endif
+
+    switch (opcode >> 12) {
+        case 0x6: case 0x7: case 0x8:
+#ifdef BATCH_AVX2
+            if (batch->stats.avx2) {
+                run_alu_avx2(batch, first, opcode);
+                break;
+            }
+#endif
+            run_alu_scalar(batch, first, opcode);
+            break;
+
+        case 0xF:
+            for (uint32_t lane = first; lane < batch->lanes; lane++) {
+                if (!batch->mask[lane]) continue;
+                if (NN == 0x07) VX[lane] = batch->DT[lane];
+                else if (NN == 0x15) batch->DT[lane] = VX[lane];
+                else if (NN == 0x18) batch->ST[lane] = VX[lane];
+                else batch->I[lane] += VX[lane];
+            }
+            break;
+    }
+}
+
+/**
+ * Run one instruction on every lane; lanes at the same PC run together,
+ * each group in turn, so every lane ends up where emulate_instruction would
+ * have taken it
+ * @param batch Batch
+ * @param steps Steps left in the frame, including this one
+*/
+void step_batch(batch_t *batch, uint32_t steps) {
+    memset(batch->done, 0, batch->lanes);
+    batch->stats.steps++;
+
+    // Lanes that ran ahead sit this step out
+    if (batch->behind) {
+        for (uint32_t lane = 0; lane < batch->lanes; lane++) {
+            if (!batch->ahead[lane]) continue;
+            batch->done[lane] = 0xFF;
+            batch->behind -= --batch->ahead[lane] == 0;
+        }
+    }
+
+    // Each leader is the first lane yet to run
+    const uint8_t *next = batch->done;
+    while ((next = memchr(next, 0, batch->done + batch->lanes - next))) {
+        const uint32_t lead = next - batch->done;
+        batch->stats.groups++;
+
+        const uint16_t pc = batch->PC[lead];
+        const uint16_t opcode = fetch_opcode(batch->machines[lead].memory, pc);
+        if (!can_vectorize(opcode)) {
+            run_lane(batch, lead, steps);
+            batch->done[lead] = 0xFF;
+            continue;
+        }
+
+        const uint32_t first = lead / BATCH_VECTOR * BATCH_VECTOR;
+        batch->stats.vectorized += select_lanes(batch, first, pc, opcode);
+        run_group(batch, first, pc, opcode);
+    }
+}
+
+/**
+ * Run one frame on every lane, as emulate_frame does for a single machine
+ * @param batch Batch
+ * @param insts Instruction budget per lane
+*/
+void run_batch_frame(batch_t *batch, uint32_t insts) {
+    for (uint32_t i = 0; i < insts; i++) step_batch(batch, insts - i);
+
+    for (uint32_t lane = 0; lane < batch->lanes; lane++) {
+        if (batch->DT[lane] > 0) batch->DT[lane]--;
+        if (batch->ST[lane] > 0) batch->ST[lane]--;
+    }
+}
+
+/**
+ * Run every lane for a number of frames
+ * @param batch Batch
+ * @param frames Number of frames
+ * @param insts_per_sec Instructions per second
+*/
+void run_batch(batch_t *batch, uint64_t frames, uint32_t insts_per_sec) {
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        run_batch_frame(batch, frame_budget(insts_per_sec, frame));
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+typedef struct batch batch_t;
+
+typedef struct {
+    uint64_t steps;      // Instruction steps, each running one instruction on every lane not ahead
+    uint64_t groups;     // Sets of lanes that ran together, or single lanes that ran ahead
+    uint64_t vectorized; // Lane instructions run across lanes
+    uint64_t scalar;     // Lane instructions run through emulate_instruction
+    bool avx2;
+} batch_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+batch_t *create_batch(const chip8_t *machines, uint32_t lanes);
+void destroy_batch(batch_t *batch);
+void run_batch_frame(batch_t *batch, uint32_t insts);
+void run_batch(batch_t *batch, uint64_t frames, uint32_t insts_per_sec);
+chip8_t *get_batch_lane(batch_t *batch, uint32_t lane);
+void get_batch_stats(const batch_t *batch, batch_stats_t *stats);
+
+#endif
@@ -0,0 +1,548 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "emulator.h"
+#include "fade.h"
+#include "history.h"
+#include "jit.h"
+#include "movie.h"
+#include "synth.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define BENCH_MAX_REPS 64
+const uint64_t bench_cpu_insts = 20000000;
+const uint32_t bench_frame_insts = 100000;
+const uint64_t bench_fade_pixels = 50000000;
+const uint64_t bench_audio_samples = 50000000;
+const uint32_t bench_audio_buffer = 512;
+const uint64_t bench_history_frames = 200000;
+const size_t bench_history_bytes = 16 << 20;
+const uint64_t bench_resets = 2000000;
+const uint32_t bench_batch_lanes = 256;
+const uint32_t bench_batch_insts = 1000;
+const uint64_t bench_wait_frames = 1000000;
+
+// Types
+typedef struct {
+    const char *name;
+    const uint16_t *program;
+    size_t length;
+} bench_rom_t;
+
+typedef struct {
+    const char *name;
+    const char *variant;
+    uint64_t ops;
+    double best;
+    double median;
+} bench_result_t;
+
+/*
+ * Synthetic ROMs, one per opcode class. Loops that only touch registers
+ * carry a 24-bit counter in V0/V2/V3 (8XY4 carries into VF) so their state
+ * never recurs and idle loop detection cannot skip them.
+*/
+const uint16_t rom_alu[] = {
+    0x6101, 0x6403, 0x6505,                 // V1 = 1, V4 = 3, V5 = 5
+    0x8014, 0x82F4, 0x83F4,                 // 0x206: 24-bit counter
+    0x8454, 0x8545, 0x8641, 0x8742, 0x8843, // ADD, SUB, OR, AND, XOR
+    0x8906, 0x8A0E, 0x8B57, 0x7C07, 0x8D40, // SHR, SHL, SUBN, ADD NN, LD
+    0x1206
+};
+
+const uint16_t rom_branch[] = {
+    0x6101,                                 // V1 = 1
+    0x8014, 0x82F4, 0x83F4,                 // 0x202: 24-bit counter
+    0x3005, 0x120E, 0x6400,                 // SE, JP over, LD
+    0x4007, 0x7401,                         // 0x20E: SNE
+    0x5010, 0x9010,                         // SE VX VY, SNE VX VY
+    0x221A, 0x1202,                         // CALL, loop
+    0x00EE                                  // 0x21A: RET
+};
+
+const uint16_t rom_bcd[] = {
+    0x6B01, 0xA300,                         // VB = 1, I = 0x300
+    0x8AB4, 0xFA33, 0xF265, 0xF455,         // 0x204: BCD, load, store
+    0xF465, 0xF41E, 0xA300, 0x1204          // load, I += V4, reset I
+};
+
+const uint16_t rom_draw[] = {
+    0x00E0, 0x6000, 0x6100, 0xA000,         // Clear, x = 0, y = 0, I = font 0
+    0xD015, 0x7008, 0xD015, 0x7008,         // Eight sprites side by side,
+    0xD015, 0x7008, 0xD015, 0x7008,         // never overlapping
+    0xD015, 0x7008, 0xD015, 0x7008,
+    0xD015, 0x7008, 0xD015, 0x7008,
+    0x1200
+};
+
+const uint16_t rom_collide[] = {
+    0x6000, 0x6100, 0xA000,                 // x = 0, y = 0, I = font 0
+    0xD015, 0xD015, 0x7001, 0x1206          // 0x206: draw, erase (collides), move
+};
+
+const uint16_t rom_wait[] = {
+    0xF00A, 0x1200                          // Wait for a key that never comes
+};
+
+const bench_rom_t roms[] = {
+    { "alu", rom_alu, sizeof(rom_alu) / sizeof(uint16_t) },
+    { "branch", rom_branch, sizeof(rom_branch) / sizeof(uint16_t) },
+    { "bcd_load_store", rom_bcd, sizeof(rom_bcd) / sizeof(uint16_t) },
+    { "dxyn", rom_draw, sizeof(rom_draw) / sizeof(uint16_t) },
+    { "dxyn_collide", rom_collide, sizeof(rom_collide) / sizeof(uint16_t) },
+    { "fx0a", rom_wait, sizeof(rom_wait) / sizeof(uint16_t) },
+};
+
+// Spends nearly every frame polling DT, so it is run frame by frame instead
+const uint16_t rom_dt_wait[] = {
+    0x60FF, 0xF015,                         // DT = 255
+    0xF107, 0x3100, 0x1204,                 // 0x204: wait for DT to run out
+    0x7201, 0xF229, 0x00E0, 0xD345, 0x1200  // Count, show the count, start over
+};
+
+const bench_rom_t dt_wait_rom = { "dt_wait", rom_dt_wait, sizeof(rom_dt_wait) / sizeof(uint16_t) };
+
+// Config
+uint32_t reps = 5;
+const char *output = NULL;
+
+// Shared machine, too large for the stack
+chip8_t chip8;
+
+/* -------------------------------------------------------------------------- */
+/*                                   HELPERS                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get monotonic time in seconds
+ * @return Current time
+*/
+double get_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Sort comparator for doubles
+ * @param a First value
+ * @param b Second value
+ * @return Ordering
+*/
+int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Fill in best and median from per-repetition times
+ * @param result Result to fill in
+ * @param times Elapsed seconds of each repetition
+*/
+void summarize(bench_result_t *result, double *times) {
+    qsort(times, reps, sizeof(double), compare_doubles);
+    result->best = times[0];
+    result->median = times[reps / 2];
+}
+
+/**
+ * Load a synthetic ROM
+ * @param rom ROM to load
+ * @return Whether loading was successful
+*/
+bool load_bench_rom(const bench_rom_t *rom) {
+    // Instructions are stored big-endian
+    uint8_t bytes[2 * 64];
+    for (size_t i = 0; i < rom->length; i++) {
+        bytes[2 * i] = rom->program[i] >> 8;
+        bytes[2 * i + 1] = rom->program[i] & 0xFF;
+    }
+
+    if (!load_rom_buffer(&chip8, bytes, 2 * rom->length)) return false;
+
+    reset_emulator(&chip8);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 BENCHMARKS                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Run a synthetic ROM for a fixed number of instructions per repetition
+ * @param rom ROM to run
+ * @param jit Whether to use the recompiler
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_rom(const bench_rom_t *rom, bool jit, bench_result_t *result) {
+    chip8.jit = NULL;
+    if (jit && !create_jit(&chip8, false)) return false;
+
+    double times[BENCH_MAX_REPS];
+    bool ok = true;
+
+    // First round is warmup
+    for (uint32_t rep = 0; rep <= reps && ok; rep++) {
+        ok = load_bench_rom(rom);
+
+        const double start = get_time();
+        for (uint64_t done = 0; done < bench_cpu_insts; done += bench_frame_insts) {
+            emulate_frame(&chip8, bench_frame_insts);
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+    }
+
+    destroy_jit(&chip8);
+    if (!ok) return false;
+
+    result->name = rom->name;
+    result->variant = jit ? "jit" : "interpreter";
+    result->ops = bench_cpu_insts;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Run a synthetic ROM on every lane of a batch, for as many lane instructions
+ * per repetition as bench_rom runs
+ * @param rom ROM to run
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_batch(const bench_rom_t *rom, bench_result_t *result) {
+    chip8_t *machines = malloc(bench_batch_lanes * sizeof(chip8_t));
+    if (!machines || !load_bench_rom(rom)) {
+        free(machines);
+        return false;
+    }
+    for (uint32_t lane = 0; lane < bench_batch_lanes; lane++) machines[lane] = chip8;
+
+    const uint64_t frames = bench_cpu_insts / bench_batch_lanes / bench_batch_insts;
+    double times[BENCH_MAX_REPS];
+    bool ok = true;
+
+    // First round is warmup
+    for (uint32_t rep = 0; rep <= reps && ok; rep++) {
+        batch_t *batch = create_batch(machines, bench_batch_lanes);
+        ok = batch != NULL;
+
+        const double start = get_time();
+        for (uint64_t f = 0; f < frames && ok; f++) run_batch_frame(batch, bench_batch_insts);
+        if (rep > 0) times[rep - 1] = get_time() - start;
+        destroy_batch(batch);
+    }
+
+    free(machines);
+    if (!ok) return false;
+
+    result->name = rom->name;
+    result->variant = "batch";
+    result->ops = frames * bench_batch_insts * bench_batch_lanes;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Run a ROM that waits on DT at 700 instructions per second, either frame by
+ * frame or skipping its waits as headless runs do
+ * @param skip Whether to skip frames spent waiting on DT
+ * @param result Result to fill in
+ * @param hash Set to the machine hash at the end of the run
+ * @return Whether the benchmark could run
+*/
+bool bench_dt_wait(bool skip, bench_result_t *result, uint64_t *hash) {
+    double times[BENCH_MAX_REPS];
+
+    for (uint32_t rep = 0; rep <= reps; rep++) {
+        if (!load_bench_rom(&dt_wait_rom)) return false;
+
+        const double start = get_time();
+        for (uint64_t f = 0; f < bench_wait_frames; f++) {
+            emulate_frame(&chip8, frame_budget(700, f));
+            if (!skip) continue;
+
+            uint64_t wait = count_dt_wait(&chip8);
+            if (wait > bench_wait_frames - f - 1) wait = bench_wait_frames - f - 1;
+            if (wait > 0) {
+                skip_dt_wait(&chip8, wait, (f + 1 + wait) * 700 / CHIP8_FRAME_RATE - (f + 1) * 700 / CHIP8_FRAME_RATE);
+                f += wait;
+            }
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+    }
+
+    *hash = hash_machine(&chip8);
+    result->name = dt_wait_rom.name;
+    result->variant = skip ? "skip" : "frame";
+    result->ops = bench_wait_frames;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Fade a framebuffer whose targets flip every frame, so it never converges
+ * @param name Benchmark name
+ * @param pixels Framebuffer size in pixels
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_fade(const char *name, uint32_t pixels, bench_result_t *result) {
+    uint32_t *colors = malloc(pixels * sizeof(uint32_t));
+    uint32_t *targets[2] = { malloc(pixels * sizeof(uint32_t)), malloc(pixels * sizeof(uint32_t)) };
+    if (!colors || !targets[0] || !targets[1]) {
+        free(colors);
+        free(targets[0]);
+        free(targets[1]);
+        return false;
+    }
+
+    // Checkerboard of on/off pixels, inverted on alternate frames
+    for (uint32_t i = 0; i < pixels; i++) {
+        colors[i] = 0x00000000;
+        targets[0][i] = (i ^ (i / CHIP8_WIDTH)) & 1 ? 0xFFFFFFFF : 0x000000FF;
+        targets[1][i] = (i ^ (i / CHIP8_WIDTH)) & 1 ? 0x000000FF : 0xFFFFFFFF;
+    }
+
+    const uint64_t frames = bench_fade_pixels / pixels;
+    double times[BENCH_MAX_REPS];
+
+    for (uint32_t rep = 0; rep <= reps; rep++) {
+        const double start = get_time();
+        for (uint64_t f = 0; f < frames; f++) {
+            fade_colors(colors, targets[f & 1], pixels, 0.75f);
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+    }
+
+    free(colors);
+    free(targets[0]);
+    free(targets[1]);
+
+    result->name = name;
+    result->variant = fade_kernel_name();
+    result->ops = frames * pixels;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Fill audio buffers from a sound timer that toggles every few frames
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_audio(bench_result_t *result) {
+    const uint32_t sample_rate = 44100;
+    int16_t buffer[512];
+    const uint64_t buffers = bench_audio_samples / bench_audio_buffer;
+    double times[BENCH_MAX_REPS];
+
+    for (uint32_t rep = 0; rep <= reps; rep++) {
+        synth_t *synth = create_synth(sample_rate, 440, 3000);
+        if (!synth) return false;
+
+        // Keep the producer ahead of the callback, as the emulation thread would
+        uint64_t frames = 0;
+        const double start = get_time();
+        for (uint64_t b = 0; b < buffers; b++) {
+            while (frames * sample_rate / CHIP8_FRAME_RATE < (b + 2) * bench_audio_buffer) {
+                push_synth_frame(synth, frames % 4 != 3);
+                frames++;
+            }
+            render_synth(synth, buffer, bench_audio_buffer);
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+
+        destroy_synth(synth);
+    }
+
+    result->name = "audio_fill";
+    result->variant = "synth";
+    result->ops = buffers * bench_audio_buffer;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Record rewind history for every frame of a ROM that keeps writing memory;
+ * frames are short, so the time is mostly push_history
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_history(bench_result_t *result) {
+    double times[BENCH_MAX_REPS];
+    const uint32_t insts = frame_budget(700, 0);
+
+    for (uint32_t rep = 0; rep <= reps; rep++) {
+        history_t *history = create_history(bench_history_bytes);
+        if (!history || !load_bench_rom(&roms[2])) {
+            destroy_history(history);
+            return false;
+        }
+
+        const double start = get_time();
+        for (uint64_t f = 0; f < bench_history_frames; f++) {
+            emulate_frame(&chip8, insts);
+            push_history(history, &chip8);
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+
+        destroy_history(history);
+    }
+
+    result->name = "history_push";
+    result->variant = "frame";
+    result->ops = bench_history_frames;
+    summarize(result, times);
+    return true;
+}
+
+/**
+ * Reset a machine after every short frame of a ROM that keeps writing memory,
+ * as batch runs do between short jobs
+ * @param result Result to fill in
+ * @return Whether the benchmark could run
+*/
+bool bench_reset(bench_result_t *result) {
+    double times[BENCH_MAX_REPS];
+    const uint32_t insts = frame_budget(700, 0);
+
+    for (uint32_t rep = 0; rep <= reps; rep++) {
+        if (!load_bench_rom(&roms[2])) return false;
+
+        const double start = get_time();
+        for (uint64_t r = 0; r < bench_resets; r++) {
+            emulate_frame(&chip8, insts);
+            reset_emulator(&chip8);
+        }
+        if (rep > 0) times[rep - 1] = get_time() - start;
+    }
+
+    result->name = "reset";
+    result->variant = "frame";
+    result->ops = bench_resets;
+    summarize(result, times);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   REPORT                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Print a result as a table row and append it to the machine-readable output
+ * @param result Result to report
+ * @param csv Output file, or NULL
+*/
+void report(const bench_result_t *result, FILE *csv) {
+    const double ns_per_op = result->median * 1e9 / result->ops;
+    const double mops = result->ops / result->median / 1e6;
+
+    printf("%-16s %-12s %10.3f %10.3f %10.1f\n",
+        result->name, result->variant, ns_per_op, result->best * 1e9 / result->ops, mops);
+
+    if (csv) {
+        fprintf(csv, "%s,%s,%llu,%u,%.6f,%.6f,%.3f\n",
+            result->name, result->variant, (unsigned long long)result->ops, reps,
+            ns_per_op, result->best * 1e9 / result->ops, mops);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, ":r:o:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                // Timed repetitions
+                reps = (uint32_t)strtoul(optarg, NULL, 10);
+                if (reps == 0 || reps > BENCH_MAX_REPS) {
+                    fprintf(stderr, "[ERROR] Invalid repetition count value\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'o':
+                // CSV output
+                output = optarg;
+                break;
+
+            case 'h':
+                printf("Usage: %s [...OPTIONS]\n", argv[0]);
+                printf("\n");
+                printf("Options:\n");
+                printf("  -r NUM\tSet timed repetitions after one warmup run (default: 5)\n");
+                printf("  -o FILE\tWrite results as CSV to FILE\n");
+                return EXIT_SUCCESS;
+
+            case ':':
+                fprintf(stderr, "[ERROR] Option requires a value\n");
+                return EXIT_FAILURE;
+
+            case '?':
+                fprintf(stderr, "[ERROR] Unknown option\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    FILE *csv = NULL;
+    if (output) {
+        csv = fopen(output, "w");
+        if (!csv) {
+            fprintf(stderr, "[ERROR] Unable to open '%s'\n", output);
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "benchmark,variant,ops,reps,ns_per_op_median,ns_per_op_best,mops_median\n");
+    }
+
+    // Ops are instructions for CPU benchmarks (Mops/s is MIPS), pixels for
+    // fades, samples for audio and frames for history and DT waits
+    printf("%-16s %-12s %10s %10s %10s\n", "benchmark", "variant", "ns/op", "best", "Mops/s");
+
+    bench_result_t result;
+    for (size_t i = 0; i < sizeof(roms) / sizeof(roms[0]); i++) {
+        if (bench_rom(&roms[i], false, &result)) report(&result, csv);
+        if (bench_rom(&roms[i], true, &result)) report(&result, csv);
+        if (bench_batch(&roms[i], &result)) report(&result, csv);
+    }
+
+    if (bench_fade("fade", CHIP8_WIDTH * CHIP8_HEIGHT, &result)) report(&result, csv);
+    if (bench_fade("fade_upscaled", CHIP8_WIDTH * CHIP8_HEIGHT * 16, &result)) report(&result, csv);
+    if (bench_audio(&result)) report(&result, csv);
+    if (bench_history(&result)) report(&result, csv);
+    if (bench_reset(&result)) report(&result, csv);
+
+    // Skipping DT waits has to end on the same machine as running every frame
+    int status = EXIT_SUCCESS;
+    uint64_t frame_hash = 0, skip_hash = 0;
+    if (bench_dt_wait(false, &result, &frame_hash)) report(&result, csv);
+    if (bench_dt_wait(true, &result, &skip_hash)) report(&result, csv);
+    if (frame_hash != skip_hash) {
+        fprintf(stderr, "[ERROR] Skipping DT waits ended on machine hash 0x%016llX instead of 0x%016llX\n",
+            (unsigned long long)skip_hash, (unsigned long long)frame_hash);
+        status = EXIT_FAILURE;
+    }
+
+    if (csv) fclose(csv);
+    return status;
+}
@@ -0,0 +1,124 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <string.h>
+
+#include "channel.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+const uint32_t triple_fresh = 4; // Set on the middle index when it holds an unread frame
+const uint32_t triple_index = 3;
+
+/* -------------------------------------------------------------------------- */
+/*                                TRIPLE BUFFER                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Initialize a triple buffer with three empty frames
+ * @param buffer Triple buffer
+*/
+void init_triple_buffer(triple_buffer_t *buffer) {
+    memset(buffer, 0, sizeof(triple_buffer_t));
+    buffer->back = 0;
+    buffer->middle = 1;
+    buffer->front = 2;
+}
+
+/**
+ * Frame owned by the producer, to be filled before publishing
+ * @param buffer Triple buffer
+ * @return Back frame
+*/
+frame_t *back_frame(triple_buffer_t *buffer) {
+    return &buffer->slots[buffer->back];
+}
+
+/**
+ * Hand the back frame over to the consumer and take the middle one in exchange
+ * @param buffer Triple buffer
+*/
+void publish_frame(triple_buffer_t *buffer) {
+    const uint32_t old = __atomic_exchange_n(&buffer->middle, buffer->back | triple_fresh, __ATOMIC_ACQ_REL);
+    buffer->back = old & triple_index;
+}
+
+/**
+ * Newest published frame; the previous one stays valid if nothing new arrived
+ * @param buffer Triple buffer
+ * @param fresh Set to whether the frame was published since the last call
+ * @return Front frame
+*/
+const frame_t *front_frame(triple_buffer_t *buffer, bool *fresh) {
+    *fresh = false;
+    if (__atomic_load_n(&buffer->middle, __ATOMIC_RELAXED) & triple_fresh) {
+        const uint32_t old = __atomic_exchange_n(&buffer->middle, buffer->front, __ATOMIC_ACQ_REL);
+        buffer->front = old & triple_index;
+        *fresh = true;
+    }
+
+    return &buffer->slots[buffer->front];
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                COMMAND QUEUE                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Initialize an empty command queue
+ * @param queue Command queue
+*/
+void init_command_queue(command_queue_t *queue) {
+    memset(queue, 0, sizeof(command_queue_t));
+}
+
+/**
+ * Append a command (producer side)
+ * @param queue Command queue
+ * @param command Command to send
+ * @return Whether there was room for the command
+*/
+bool push_command(command_queue_t *queue, command_t command) {
+    const uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    const uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head - tail == COMMAND_QUEUE_SIZE) return false;
+
+    queue->ring[head % COMMAND_QUEUE_SIZE] = command;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Look at the oldest command without taking it (consumer side)
+ * @param queue Command queue
+ * @param command Destination for the command
+ * @return Whether a command was available
+*/
+bool peek_command(command_queue_t *queue, command_t *command) {
+    const uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    const uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+
+    *command = queue->ring[tail % COMMAND_QUEUE_SIZE];
+    return true;
+}
+
+/**
+ * Take the oldest command (consumer side)
+ * @param queue Command queue
+ * @param command Destination for the command
+ * @return Whether a command was available
+*/
+bool pop_command(command_queue_t *queue, command_t *command) {
+    const uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    const uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+
+    *command = queue->ring[tail % COMMAND_QUEUE_SIZE];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define COMMAND_QUEUE_SIZE 256
+
+// Types
+typedef enum {
+    COMMAND_KEY_DOWN,
+    COMMAND_KEY_UP,
+    COMMAND_RESET,
+    COMMAND_SAVE_STATE,
+    COMMAND_LOAD_STATE,
+    COMMAND_REWIND_START,
+    COMMAND_REWIND_STOP
+} command_type_t;
+
+typedef struct {
+    command_type_t type;
+    uint8_t key;
+    uint8_t slot;
+    uint64_t time; // Performance counter when a key event was handled
+} command_t;
+
+typedef struct {
+    uint64_t display[CHIP8_HEIGHT];
+    uint64_t sequence;
+    uint64_t input_time; // Oldest key event not shown yet, 0 if none
+    uint64_t time;       // Performance counter when published
+    uint64_t draws;      // Frames that drew, up to this one
+    bool drawn;
+} frame_t;
+
+// Single producer, single consumer; the newest frame always wins
+typedef struct {
+    frame_t slots[3];
+    uint32_t back;
+    uint32_t middle;
+    uint32_t front;
+} triple_buffer_t;
+
+// Single producer, single consumer ring
+typedef struct {
+    command_t ring[COMMAND_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+} command_queue_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+void init_triple_buffer(triple_buffer_t *buffer);
+frame_t *back_frame(triple_buffer_t *buffer);
+void publish_frame(triple_buffer_t *buffer);
+const frame_t *front_frame(triple_buffer_t *buffer, bool *fresh);
+
+void init_command_queue(command_queue_t *queue);
+bool push_command(command_queue_t *queue, command_t command);
+bool peek_command(command_queue_t *queue, command_t *command);
+bool pop_command(command_queue_t *queue, command_t *command);
+
+#endif
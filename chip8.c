@@ -2,21 +2,38 @@
 /*                                  INCLUDES                                  */
 /* -------------------------------------------------------------------------- */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#ifndef HEADLESS
 #include <SDL2/SDL.h>
+#endif
 
-/* -------------------------------------------------------------------------- */
-/*                                   MACROS                                   */
-/* -------------------------------------------------------------------------- */
+#include "batch.h"
+#include "channel.h"
+#include "emulator.h"
+#include "fade.h"
+#include "histogram.h"
+#include "history.h"
+#include "jit.h"
+#include "movie.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "synth.h"
+
+#ifdef PROFILE
+#include "profile.h"
+#endif
 
-#ifdef DEBUG
-#define debug_print(...) do { printf(__VA_ARGS__); } while (false)
-#else
-#define debug_print(...) do {} while (false)
+#ifdef TRACE
+#include "trace.h"
 #endif
 
 /* -------------------------------------------------------------------------- */
@@ -24,25 +41,8 @@
 /* -------------------------------------------------------------------------- */
 
 // Constants
-const uint32_t entry_point = 0x200;
-const uint8_t font[] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
+const uint32_t max_input_slices = 64;
+const uint32_t command_retry_ms = 100;
 
 // Types
 typedef enum {
@@ -51,48 +51,158 @@ typedef enum {
     QUIT
 } state_t;
 
+typedef enum {
+    INTERPRETER,
+    JIT,
+    DIFF,
+    BATCH,
+    BATCH_DIFF
+} engine_t;
+
+typedef enum {
+    PRESENT_VSYNC,
+    PRESENT_ADAPTIVE, // Vsync that tears instead of waiting a whole refresh when late
+    PRESENT_UNCAPPED  // No vsync, presents held to present_limit per second
+} present_mode_t;
+
+typedef struct {
+    uint64_t freq;      // Performance counter ticks per second
+    uint64_t origin;    // Deadline of the first frame since the last resync
+    uint64_t ticks;     // Frames scheduled since origin
+    uint64_t last;      // Wake time of the previous frame
+    uint64_t oversleep; // Average SDL_Delay overshoot, in ticks
+
+    // Stats
+    uint64_t frames;
+    uint64_t insts;
+    uint64_t run_ticks;
+    uint64_t resyncs;
+    double jitter_sq_sum;
+    double jitter_max;
+} scheduler_t;
+
+typedef struct {
+    uint64_t draws;      // Frames that drew, up to the newest frame taken
+    uint64_t first;      // End of the first present
+    uint64_t last;       // End of the previous present
+
+    // Stats
+    uint64_t presents;
+    uint64_t duplicated; // Presents that showed no new emulated frame, such as fade steps
+    uint64_t dropped;    // Frames that drew but were replaced before being taken
+    uint64_t missed;     // Presents that ended after the next emulated frame was due
+    histogram_t duration;
+} present_stats_t;
+
 // Config
-uint32_t width = 64;
-uint32_t height = 32;
+uint32_t width = CHIP8_WIDTH;
+uint32_t height = CHIP8_HEIGHT;
 uint32_t scale = 15;
 uint32_t bg_color = 0x00000000;
 uint32_t fg_color = 0xFFFFFFFF;
 char *args_rom = NULL;
 bool pixel_outline = false;
 uint32_t insts_per_sec = 700;
+uint32_t input_slices = 1;
+present_mode_t present_mode = PRESENT_VSYNC;
+uint32_t present_limit = 0;
 uint32_t sound_freq = 440;
 uint32_t audio_sample_rate = 44100;
+uint32_t audio_buffer_size = 512;
 int16_t volume = 3000;
+uint32_t rewind_memory = 16;
 float color_lerp_rate = 0.75f;
+uint64_t max_frames = 0;
+uint64_t max_insts = 0;
+uint32_t instances = 1;
+uint32_t threads = 0;
+engine_t engine = INTERPRETER;
+uint64_t seed = 0;
+const char *record_name = NULL;
+const char *replay_name = NULL;
+const char *hash_log_name = NULL;
+
+#ifdef PROFILE
+const char *profile_report_name = "profile.txt";
+const char *profile_folded_name = "profile.folded";
+#endif
+
+#ifdef TRACE
+const char *trace_name = "trace.bin";
+uint32_t trace_capacity = 1 << 22;
+#endif
 
+#ifndef HEADLESS
 // SDL
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
+SDL_Texture *screen_texture = NULL;
+SDL_Texture *outline_texture = NULL;
 SDL_AudioSpec desired, obtained;
 SDL_AudioDeviceID audio;
+synth_t *synth = NULL;
+
+// Emulation thread; chip8 is owned by it while it runs
+SDL_Thread *emulation = NULL;
+SDL_sem *wake = NULL;
+uint32_t frame_event = 0;
+bool frame_pending = false;
+triple_buffer_t frames;
+command_queue_t commands;
+uint64_t dropped_commands = 0; // Main thread only; sends that found the queue full for too long
+scheduler_t scheduler;
+
+// Presentation, owned by the main thread; pacer only limits uncapped presents
+scheduler_t pacer;
+present_stats_t presents = {0};
+
+// Save states; each buffer is handed between the threads through its pending flag
+uint32_t snapshot_event = 0;
+snapshot_t save_buffer;
+snapshot_t load_buffer;
+bool save_pending = false;
+bool load_pending = false;
+uint8_t saved_slot = 0;
+uint8_t state_slot = 0;
+
+// Rewind history, owned by the emulation thread
+history_t *history = NULL;
+bool rewinding = false;
+
+// Input movie being recorded, owned by the emulation thread
+movie_t *recording = NULL;
+
+// Input-to-photon latency. Frames carry the oldest key event the emulation thread
+// has applied but the main thread has not presented yet; shown_input acknowledges it
+histogram_t input_latency = {0};
+uint64_t pending_input = 0;
+uint64_t presenting_input = 0;
+uint64_t shown_input = 0;
+
+// Frames that drew, counted by the emulation thread for the present stats
+uint64_t drawn_frames = 0;
+#endif
 
 // Emulator
 state_t state = RUNNING;
-uint8_t memory[4096] = {0};
-uint16_t stack[16] = {0};
-uint8_t sp = 0;
-uint8_t V[16] = {0};
-uint16_t PC = entry_point;
-uint16_t I = 0;
-uint8_t DT = 0;
-uint8_t ST = 0;
-uint32_t pixel_colors[64 * 32] = {0};
-bool display[64 * 32] = {false};
-bool keypad[16] = {false};
-bool draw_flag = false;
-char *rom = NULL;
+chip8_t chip8 = {0};
+uint32_t pixel_colors[CHIP8_WIDTH * CHIP8_HEIGHT] = {0};
+uint32_t target_colors[CHIP8_WIDTH * CHIP8_HEIGHT] = {0};
+
+// Renderer state, one bit per pixel in the same layout as the display
+uint64_t shown_display[CHIP8_HEIGHT] = {0};
+uint64_t fading_pixels[CHIP8_HEIGHT] = {0};
+bool redraw = true;
 
 /* -------------------------------------------------------------------------- */
 /*                                 PROTOTYPES                                 */
 /* -------------------------------------------------------------------------- */
 
-bool init_emulator(char *rom_name);
-void update_screen();
+#ifndef HEADLESS
+bool update_screen();
+void print_present_stats();
+uint64_t wait_deadline(scheduler_t *scheduler, uint64_t target, uint64_t now);
+#endif
 
 /* -------------------------------------------------------------------------- */
 /*                                   CONFIG                                   */
@@ -105,9 +215,12 @@ void update_screen();
  * @return Whether setup was successful
 */
 bool set_config(int argc, char **argv) {
+    // Unseeded runs differ every time
+    seed = (uint64_t)time(NULL);
+
     // Options
     int opt;
-    while ((opt = getopt(argc, argv, ":s:i:b:f:h")) != -1) {
+    while ((opt = getopt(argc, argv, ":s:i:t:v:F:b:f:a:r:e:n:m:c:j:S:w:p:l:h")) != -1) {
         switch (opt) {
             case 's':
                 // Scale
@@ -127,6 +240,35 @@ bool set_config(int argc, char **argv) {
                 }
                 break;
             
+            case 't':
+                // Input slices per frame
+                input_slices = (uint32_t)strtoul(optarg, NULL, 10);
+                if (input_slices == 0 || input_slices > max_input_slices) {
+                    fprintf(stderr, "[ERROR] Invalid input slices value\n");
+                    return false;
+                }
+                break;
+            
+            case 'v':
+                // Present mode
+                if (strcmp(optarg, "vsync") == 0) present_mode = PRESENT_VSYNC;
+                else if (strcmp(optarg, "adaptive") == 0) present_mode = PRESENT_ADAPTIVE;
+                else if (strcmp(optarg, "uncapped") == 0) present_mode = PRESENT_UNCAPPED;
+                else {
+                    fprintf(stderr, "[ERROR] Invalid present mode value\n");
+                    return false;
+                }
+                break;
+            
+            case 'F':
+                // Present limit when uncapped
+                present_limit = (uint32_t)strtoul(optarg, NULL, 10);
+                if (present_limit == 0) {
+                    fprintf(stderr, "[ERROR] Invalid present limit value\n");
+                    return false;
+                }
+                break;
+            
             case 'b':
                 // Background color
                 bg_color = (uint32_t)strtoul(optarg, NULL, 16);
@@ -137,6 +279,89 @@ bool set_config(int argc, char **argv) {
                 fg_color = (uint32_t)strtoul(optarg, NULL, 16);
                 break;
             
+            case 'a':
+                // Audio buffer size
+                audio_buffer_size = (uint32_t)strtoul(optarg, NULL, 10);
+                if (audio_buffer_size < 16 || audio_buffer_size > 8192 || (audio_buffer_size & (audio_buffer_size - 1))) {
+                    fprintf(stderr, "[ERROR] Invalid audio buffer size value\n");
+                    return false;
+                }
+                break;
+            
+            case 'r':
+                // Rewind memory
+                rewind_memory = (uint32_t)strtoul(optarg, NULL, 10);
+                if (rewind_memory >= 4096) {
+                    fprintf(stderr, "[ERROR] Invalid rewind memory value\n");
+                    return false;
+                }
+                break;
+            
+            case 'e':
+                // CPU engine
+                if (strcmp(optarg, "interpreter") == 0) engine = INTERPRETER;
+                else if (strcmp(optarg, "jit") == 0) engine = JIT;
+                else if (strcmp(optarg, "diff") == 0) engine = DIFF;
+                else if (strcmp(optarg, "batch") == 0) engine = BATCH;
+                else if (strcmp(optarg, "batchdiff") == 0) engine = BATCH_DIFF;
+                else {
+                    fprintf(stderr, "[ERROR] Invalid engine value\n");
+                    return false;
+                }
+                break;
+            
+            case 'n':
+                // Frame limit (headless)
+                max_frames = strtoull(optarg, NULL, 10);
+                if (max_frames == 0) {
+                    fprintf(stderr, "[ERROR] Invalid frame limit value\n");
+                    return false;
+                }
+                break;
+            
+            case 'm':
+                // Instruction limit (headless)
+                max_insts = strtoull(optarg, NULL, 10);
+                if (max_insts == 0) {
+                    fprintf(stderr, "[ERROR] Invalid instruction limit value\n");
+                    return false;
+                }
+                break;
+            
+            case 'c':
+                // Instance count (headless)
+                instances = (uint32_t)strtoul(optarg, NULL, 10);
+                if (instances == 0) {
+                    fprintf(stderr, "[ERROR] Invalid instance count value\n");
+                    return false;
+                }
+                break;
+            
+            case 'j':
+                // Worker thread count (headless)
+                threads = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            
+            case 'S':
+                // Random seed
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            
+            case 'w':
+                // Input movie to record
+                record_name = optarg;
+                break;
+            
+            case 'p':
+                // Input movie to replay (headless)
+                replay_name = optarg;
+                break;
+            
+            case 'l':
+                // Frame hash log (headless)
+                hash_log_name = optarg;
+                break;
+            
             case 'h':
                 // Print help
                 printf("Usage: %s [...OPTIONS] ROM_NAME\n", argv[0]);
@@ -144,8 +369,22 @@ bool set_config(int argc, char **argv) {
                 printf("Options:\n");
                 printf("  -s NUM\tSet pixel scale factor (default: 15)\n");
                 printf("  -i NUM\tSet instructions per second (default: 700)\n");
+                printf("  -t NUM\tPoll input NUM times per frame, up to %u (not headless, default: 1)\n", max_input_slices);
+                printf("  -v MODE\tSet present mode: vsync, adaptive or uncapped (not headless, default: vsync)\n");
+                printf("  -F NUM\tLimit uncapped presents to NUM per second (not headless, default: display refresh rate)\n");
                 printf("  -b RGBA\tSet background color in hex (default: 00000000)\n");
                 printf("  -f RGBA\tSet foreground color in hex (default: FFFFFFFF)\n");
+                printf("  -a NUM\tSet audio buffer size in samples, a power of two (default: 512)\n");
+                printf("  -r NUM\tSet rewind memory in MiB, 0 to disable (default: 16)\n");
+                printf("  -e NAME\tSet CPU engine: interpreter, jit, diff, batch or batchdiff (default: interpreter)\n");
+                printf("  -n NUM\tStop after NUM frames (headless only)\n");
+                printf("  -m NUM\tStop after NUM instructions (headless only)\n");
+                printf("  -c NUM\tRun NUM instances in parallel (headless only, default: 1)\n");
+                printf("  -j NUM\tSet worker thread count (headless only, default: all cores)\n");
+                printf("  -S NUM\tSet random seed (default: current time)\n");
+                printf("  -w FILE\tRecord input to a movie (not headless)\n");
+                printf("  -p FILE\tReplay a movie at full speed, using its seed and speed (headless only)\n");
+                printf("  -l FILE\tLog the machine hash after every replayed frame (headless only)\n");
                 exit(EXIT_SUCCESS);
             
             case ':':
@@ -171,11 +410,80 @@ bool set_config(int argc, char **argv) {
         return false;
     }
 
+    const bool batched = engine == BATCH || engine == BATCH_DIFF;
+
+#ifdef HEADLESS
+    // Headless runs need an end condition; replays end with the movie
+    if (replay_name) {
+        if (max_frames != 0 || max_insts != 0 || instances > 1) {
+            fprintf(stderr, "[ERROR] Replays run a single instance to the end of the movie\n");
+            return false;
+        }
+    } else if (max_frames == 0 && max_insts == 0) {
+        fprintf(stderr, "[ERROR] Headless mode requires a frame or instruction limit\n");
+        return false;
+    }
+
+    // Parallel and batched runs are scheduled in whole frames
+    if ((instances > 1 || batched) && (max_frames == 0 || max_insts != 0)) {
+        fprintf(stderr, "[ERROR] Multiple instances require a frame limit only\n");
+        return false;
+    }
+
+    if (hash_log_name && !replay_name) {
+        fprintf(stderr, "[ERROR] Frame hash logs require a replay\n");
+        return false;
+    }
+
+    if (record_name) {
+        fprintf(stderr, "[ERROR] Recording requires the SDL frontend\n");
+        return false;
+    }
+
+    // Replays take the slicing the movie was recorded with
+    if (input_slices != 1) {
+        fprintf(stderr, "[ERROR] Input slices require the SDL frontend\n");
+        return false;
+    }
+#else
+    if (replay_name || hash_log_name) {
+        fprintf(stderr, "[ERROR] Replays require headless mode\n");
+        return false;
+    }
+
+    if (batched) {
+        fprintf(stderr, "[ERROR] Batch engines require headless mode\n");
+        return false;
+    }
+#endif
+
+#if defined(PROFILE) || defined(TRACE)
+    // Profiles and traces follow what the interpreter runs on a single machine
+    if (engine != INTERPRETER || instances > 1) {
+        fprintf(stderr, "[ERROR] Profiling and tracing require the interpreter and a single instance\n");
+        return false;
+    }
+#endif
+
     // Set ROM name
     args_rom = argv[arg_pos];
     return true;
 }
 
+/**
+ * Attach the configured CPU engine to a machine
+ * @param machine Machine instance
+ * @return Whether the engine could be set up
+*/
+bool init_engine(chip8_t *machine) {
+    machine->jit = NULL;
+    if (engine != JIT && engine != DIFF) return true;
+
+    return create_jit(machine, engine == DIFF);
+}
+
+#ifndef HEADLESS
+
 /* -------------------------------------------------------------------------- */
 /*                                     SDL                                    */
 /* -------------------------------------------------------------------------- */
@@ -187,17 +495,82 @@ bool set_config(int argc, char **argv) {
  * @param len Length of the buffer
 */
 void audio_callback(void *userdata, uint8_t *stream, int len) {
-    (void)userdata;
+    render_synth(userdata, (int16_t *)stream, (uint32_t)len / sizeof(int16_t));
+}
+
+/**
+ * Create the screen texture and the precomputed pixel outline overlay
+ * @return Whether creation was successful
+*/
+bool init_textures() {
+    // One texel per CHIP-8 pixel, scaled up by a single copy per frame
+    screen_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!screen_texture) {
+        fprintf(stderr, "[ERROR] Unable to create screen texture: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(screen_texture, SDL_BLENDMODE_NONE);
+
+    // Outline grid in the background color, transparent everywhere else
+    const uint32_t outline_w = width * scale;
+    const uint32_t outline_h = height * scale;
+    uint32_t *outline = malloc(outline_w * outline_h * sizeof(uint32_t));
+    if (!outline) {
+        fprintf(stderr, "[ERROR] Unable to allocate outline overlay\n");
+        return false;
+    }
 
-    int16_t *audio_data = (int16_t *)stream;
-    static uint32_t sample_index = 0;
-    const int32_t sound_period = audio_sample_rate / sound_freq;
-    const int32_t half_sound_period = sound_period / 2;
+    for (uint32_t y = 0; y < outline_h; y++) {
+        for (uint32_t x = 0; x < outline_w; x++) {
+            const uint32_t cell_x = x % scale;
+            const uint32_t cell_y = y % scale;
+            const bool edge = cell_x == 0 || cell_y == 0 || cell_x == scale - 1 || cell_y == scale - 1;
+            outline[y * outline_w + x] = edge ? (bg_color | 0xFF) : 0;
+        }
+    }
 
-    // Fill audio data buffer 2 bytes at a time
-    for (int i = 0; i < len / 2; i++) {
-        audio_data[i] = ((sample_index++ / half_sound_period) % 2) ? volume : -volume;
+    outline_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, outline_w, outline_h);
+    if (!outline_texture) {
+        fprintf(stderr, "[ERROR] Unable to create outline texture: %s\n", SDL_GetError());
+        free(outline);
+        return false;
     }
+    SDL_UpdateTexture(outline_texture, NULL, outline, outline_w * sizeof(uint32_t));
+    SDL_SetTextureBlendMode(outline_texture, SDL_BLENDMODE_BLEND);
+    free(outline);
+
+    return true;
+}
+
+/**
+ * Settle on the present mode the renderer can do, falling back from adaptive
+ * vsync to vsync and from vsync to limited uncapped presents
+*/
+void init_present_mode() {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0) info = (SDL_RendererInfo){ .name = "unknown" };
+
+    // The renderer's OpenGL context, if any, is current after creation
+    if (present_mode == PRESENT_ADAPTIVE && SDL_GL_SetSwapInterval(-1) != 0) {
+        printf("[INFO] Adaptive vsync unavailable with the '%s' renderer, using vsync\n", info.name);
+        present_mode = PRESENT_VSYNC;
+    }
+
+    if (present_mode != PRESENT_UNCAPPED && !(info.flags & SDL_RENDERER_PRESENTVSYNC)) {
+        printf("[INFO] Vsync unavailable with the '%s' renderer, limiting presents instead\n", info.name);
+        present_mode = PRESENT_UNCAPPED;
+    }
+
+    // Presenting faster than the display refreshes only tears
+    if (present_mode == PRESENT_UNCAPPED && present_limit == 0) {
+        SDL_DisplayMode mode;
+        const int display = SDL_GetWindowDisplayIndex(window);
+        const bool known = display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0;
+        present_limit = known ? (uint32_t)mode.refresh_rate : CHIP8_FRAME_RATE;
+    }
+
+    if (present_mode == PRESENT_UNCAPPED) printf("[INFO] Presenting uncapped, up to %u per second\n", present_limit);
+    else printf("[INFO] Presenting with %svsync\n", present_mode == PRESENT_ADAPTIVE ? "adaptive " : "");
 }
 
 /**
@@ -223,18 +596,39 @@ bool init_sdl() {
         return false;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Adaptive vsync is only exposed through OpenGL swap intervals
+    if (present_mode == PRESENT_ADAPTIVE) SDL_SetHint(SDL_HINT_RENDER_DRIVER, "opengl");
+    const uint32_t vsync = present_mode != PRESENT_UNCAPPED ? SDL_RENDERER_PRESENTVSYNC : 0;
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | vsync);
+    if (!renderer) {
+        // Fall back to the software renderer on machines without a GPU
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE | vsync);
+    }
     if (!renderer) {
         fprintf(stderr, "[ERROR] Unable to create renderer: %s\n", SDL_GetError());
         return false;
     }
 
+    init_present_mode();
+    if (!init_textures()) return false;
+
+    // Pixel colors start out black, so every pixel fades in
+    memset(fading_pixels, 0xFF, sizeof(fading_pixels));
+
+    synth = create_synth(audio_sample_rate, sound_freq, volume);
+    if (!synth) {
+        fprintf(stderr, "[ERROR] Unable to create audio synthesizer\n");
+        return false;
+    }
+
     desired = (SDL_AudioSpec){
         .freq = audio_sample_rate,
         .format = AUDIO_S16LSB,
         .channels = 1,
-        .samples = 512,
+        .samples = audio_buffer_size,
         .callback = audio_callback,
+        .userdata = synth,
     };
 
     audio = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
@@ -248,642 +642,979 @@ bool init_sdl() {
         return false;
     }
 
+    // The device plays silence while the sound timer is off, so it is never paused
+    SDL_PauseAudioDevice(audio, 0);
+
     return true;
 }
 
 /**
- * SDL event handler
+ * Queue a command for the emulation thread and wake it if it is idle
+ * @param command Command to send
 */
-void handle_events() {
-    SDL_Event event;
-
-    while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_QUIT:
-                // Quit emulator
-                state = QUIT;
-                break;
-            
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.scancode) {
-                    case SDL_SCANCODE_ESCAPE:
-                        // Quit emulator (ESC key)
-                        state = QUIT;
-                        break;
-                    
-                    case SDL_SCANCODE_SPACE:
-                        // Toggle pause
-                        if (state == PAUSED) {
-                            state = RUNNING;
-                            printf("[INFO] Unpaused\n");
-                        } else {
-                            state = PAUSED;
-                            printf("[INFO] Paused\n");
-                        }
-                        break;
-                    
-                    case SDL_SCANCODE_BACKSPACE:
-                        // Reset emulator for current ROM
-                        init_emulator(rom);
-                        break;
-                    
-                    case SDL_SCANCODE_U:
-                        // Decrease lerp rate
-                        if (color_lerp_rate > 0.05) color_lerp_rate -= 0.05;
-                        break;
-
-                    case SDL_SCANCODE_I:
-                        // Increase lerp rate
-                        if (color_lerp_rate < 1) color_lerp_rate += 0.05;
-                        break;
-
-                    case SDL_SCANCODE_O:
-                        // Decrease volume
-                        if (volume > 0) volume -= 500;
-                        break;
-
-                    case SDL_SCANCODE_P:
-                        // Increase volme
-                        if (volume < INT16_MAX) volume += 500;
-                        break;
-                    
-                    case SDL_SCANCODE_L:
-                        // Toggle pixel outline
-                        pixel_outline = !pixel_outline;
-                        update_screen();
-                        break;
-                    
-                    // Keypad mappings
-                    case SDL_SCANCODE_1: keypad[0x1] = true; break;
-                    case SDL_SCANCODE_2: keypad[0x2] = true; break;
-                    case SDL_SCANCODE_3: keypad[0x3] = true; break;
-                    case SDL_SCANCODE_4: keypad[0xC] = true; break;
-                    case SDL_SCANCODE_Q: keypad[0x4] = true; break;
-                    case SDL_SCANCODE_W: keypad[0x5] = true; break;
-                    case SDL_SCANCODE_E: keypad[0x6] = true; break;
-                    case SDL_SCANCODE_R: keypad[0xD] = true; break;
-                    case SDL_SCANCODE_A: keypad[0x7] = true; break;
-                    case SDL_SCANCODE_S: keypad[0x8] = true; break;
-                    case SDL_SCANCODE_D: keypad[0x9] = true; break;
-                    case SDL_SCANCODE_F: keypad[0xE] = true; break;
-                    case SDL_SCANCODE_Z: keypad[0xA] = true; break;
-                    case SDL_SCANCODE_X: keypad[0x0] = true; break;
-                    case SDL_SCANCODE_C: keypad[0xB] = true; break;
-                    case SDL_SCANCODE_V: keypad[0xF] = true; break;
-
-                    default:
-                        break;
-                }
-                break;
-            
-            case SDL_KEYUP:
-                switch (event.key.keysym.scancode) {
-                    // Keypad mappings
-                    case SDL_SCANCODE_1: keypad[0x1] = false; break;
-                    case SDL_SCANCODE_2: keypad[0x2] = false; break;
-                    case SDL_SCANCODE_3: keypad[0x3] = false; break;
-                    case SDL_SCANCODE_4: keypad[0xC] = false; break;
-                    case SDL_SCANCODE_Q: keypad[0x4] = false; break;
-                    case SDL_SCANCODE_W: keypad[0x5] = false; break;
-                    case SDL_SCANCODE_E: keypad[0x6] = false; break;
-                    case SDL_SCANCODE_R: keypad[0xD] = false; break;
-                    case SDL_SCANCODE_A: keypad[0x7] = false; break;
-                    case SDL_SCANCODE_S: keypad[0x8] = false; break;
-                    case SDL_SCANCODE_D: keypad[0x9] = false; break;
-                    case SDL_SCANCODE_F: keypad[0xE] = false; break;
-                    case SDL_SCANCODE_Z: keypad[0xA] = false; break;
-                    case SDL_SCANCODE_X: keypad[0x0] = false; break;
-                    case SDL_SCANCODE_C: keypad[0xB] = false; break;
-                    case SDL_SCANCODE_V: keypad[0xF] = false; break;
-
-                    default:
-                        break;
-                }
-                break;
-            
-            default:
-                break;
+void send_command(command_t command) {
+    // A full queue means the emulation thread is stalled; losing a key-up would
+    // leave the key stuck, so give it time to drain first
+    for (uint32_t waited = 0; !push_command(&commands, command); waited++) {
+        if (waited == command_retry_ms) {
+            dropped_commands++;
+            return;
         }
+        SDL_SemPost(wake);
+        SDL_Delay(1);
     }
+    SDL_SemPost(wake);
 }
 
 /**
- * Extract color components in RGBA format
- * @param color RGBA color
- * @param r Pointer to R component
- * @param g Pointer to G component
- * @param b Pointer to B component
- * @param a Pointer to A component
+ * Forward a keypad change to the emulation thread
+ * @param key CHIP-8 key
+ * @param down Whether the key was pressed or released
 */
-void extract_color(uint32_t color, uint8_t *r, uint8_t *g, uint8_t *b, uint8_t *a) {
-    *r = (color >> 24) & 0xFF;
-    *g = (color >> 16) & 0xFF;
-    *b = (color >>  8) & 0xFF;
-    *a = (color >>  0) & 0xFF;
+void send_key(uint8_t key, bool down) {
+    send_command((command_t){
+        .type = down ? COMMAND_KEY_DOWN : COMMAND_KEY_UP,
+        .key = key,
+        .time = SDL_GetPerformanceCounter(),
+    });
 }
 
 /**
- * Linear interpolation between two colors
- * @param start_color Initial color
- * @param end_color Final color
- * @param t Color lerp rate
- * @return Intermediate color
+ * Change the run state shared with the emulation thread and wake it
+ * @param next New state
 */
-uint32_t color_lerp(uint32_t start_color, uint32_t end_color, float t) {
-    // Extract start color components
-    uint8_t s_r, s_g, s_b, s_a;
-    extract_color(start_color, &s_r, &s_g, &s_b, &s_a);
+void set_state(state_t next) {
+    __atomic_store_n(&state, next, __ATOMIC_RELAXED);
+    SDL_SemPost(wake);
+}
 
-    // Extract end color components
-    uint8_t e_r, e_g, e_b, e_a;
-    extract_color(end_color, &e_r, &e_g, &e_b, &e_a);
+/**
+ * Build the file name of a save state slot
+ * @param slot Save state slot
+ * @param name Output buffer
+ * @param size Output buffer size
+*/
+void state_name(uint8_t slot, char *name, size_t size) {
+    snprintf(name, size, "%s.state%u", args_rom, slot);
+}
 
-    // Get lerped color components
-    uint8_t l_r = ((1 - t) * s_r) + (t * e_r);
-    uint8_t l_g = ((1 - t) * s_g) + (t * e_g);
-    uint8_t l_b = ((1 - t) * s_b) + (t * e_b);
-    uint8_t l_a = ((1 - t) * s_a) + (t * e_a);
+/**
+ * Write the snapshot handed off by the emulation thread, then hand the buffer back
+*/
+void store_state() {
+    char name[FILENAME_MAX];
+    state_name(saved_slot, name, sizeof(name));
+    if (write_snapshot(&save_buffer, name)) printf("[INFO] Saved state '%s'\n", name);
 
-    return (l_r << 24) | (l_g << 16) | (l_b << 8) | l_a;
+    __atomic_store_n(&save_pending, false, __ATOMIC_RELEASE);
 }
 
 /**
- * Draw display contents to the screen
+ * Read a save state and hand it to the emulation thread to restore
+ * @param slot Save state slot
 */
-void update_screen() {
-    SDL_Rect rect = { .x = 0, .y = 0, .w = scale, .h = scale };
+void load_state(uint8_t slot) {
+    // The previous state has not been picked up yet
+    if (__atomic_load_n(&load_pending, __ATOMIC_ACQUIRE)) return;
+
+    char name[FILENAME_MAX];
+    state_name(slot, name, sizeof(name));
+    const snapshot_t *snapshot = map_snapshot(name);
+    if (!snapshot) return;
+
+    load_buffer = *snapshot;
+    unmap_snapshot(snapshot);
+    __atomic_store_n(&load_pending, true, __ATOMIC_RELAXED);
+    send_command((command_t){ .type = COMMAND_LOAD_STATE });
+    printf("[INFO] Loaded state '%s'\n", name);
+}
 
-    // Extract background color components
-    uint8_t bg_r, bg_g, bg_b, bg_a;
-    extract_color(bg_color, &bg_r, &bg_g, &bg_b, &bg_a);
+/**
+ * SDL event handler
+ * @param event Event to handle
+*/
+void handle_event(const SDL_Event *event) {
+    if (event->type == snapshot_event) {
+        store_state();
+        return;
+    }
 
-    // Extract foreground color components
-    uint8_t fg_r, fg_g, fg_b, fg_a;
-    extract_color(fg_color, &fg_r, &fg_g, &fg_b, &fg_a);
+    switch (event->type) {
+        case SDL_QUIT:
+            // Quit emulator
+            set_state(QUIT);
+            break;
+        
+        case SDL_KEYDOWN:
+            switch (event->key.keysym.scancode) {
+                case SDL_SCANCODE_ESCAPE:
+                    // Quit emulator (ESC key)
+                    set_state(QUIT);
+                    break;
+                
+                case SDL_SCANCODE_SPACE:
+                    // Toggle pause
+                    if (state == PAUSED) {
+                        set_state(RUNNING);
+                        printf("[INFO] Unpaused\n");
+                    } else {
+                        set_state(PAUSED);
+                        printf("[INFO] Paused\n");
+                    }
+                    break;
+                
+                case SDL_SCANCODE_BACKSPACE:
+                    // Reset emulator for current ROM
+                    send_command((command_t){ .type = COMMAND_RESET });
+                    break;
+                
+                case SDL_SCANCODE_U:
+                    // Decrease lerp rate
+                    if (color_lerp_rate > 0.05) color_lerp_rate -= 0.05;
+                    break;
+
+                case SDL_SCANCODE_I:
+                    // Increase lerp rate
+                    if (color_lerp_rate < 1) color_lerp_rate += 0.05;
+                    break;
+
+                case SDL_SCANCODE_O:
+                    // Decrease volume
+                    if (volume > 0) volume -= 500;
+                    set_synth_volume(synth, volume);
+                    break;
 
-    // Loop through display pixels
-    for (uint32_t i = 0; i < sizeof(display); i++) {
-        rect.x = (i % width) * scale;
-        rect.y = (i / width) * scale;
+                case SDL_SCANCODE_P:
+                    // Increase volme
+                    if (volume < INT16_MAX) volume += 500;
+                    set_synth_volume(synth, volume);
+                    break;
+                
+                case SDL_SCANCODE_L:
+                    // Toggle pixel outline
+                    pixel_outline = !pixel_outline;
+                    redraw = true;
+                    break;
+
+                case SDL_SCANCODE_F5:
+                    // Save state to the current slot
+                    send_command((command_t){ .type = COMMAND_SAVE_STATE, .slot = state_slot });
+                    break;
+
+                case SDL_SCANCODE_F6:
+                    // Previous save state slot
+                    if (state_slot > 0) state_slot--;
+                    printf("[INFO] State slot %u\n", state_slot);
+                    break;
 
-        if (display[i]) {
-            // Pixel on, lerp towards foreground color if not already there
-            if (pixel_colors[i] != fg_color) {
-                pixel_colors[i] = color_lerp(pixel_colors[i], fg_color, color_lerp_rate);
+                case SDL_SCANCODE_F7:
+                    // Next save state slot
+                    if (state_slot < 9) state_slot++;
+                    printf("[INFO] State slot %u\n", state_slot);
+                    break;
+
+                case SDL_SCANCODE_F9:
+                    // Load state from the current slot
+                    load_state(state_slot);
+                    break;
+
+                case SDL_SCANCODE_F1:
+                    // Print presentation and latency stats so far
+                    print_present_stats();
+                    print_histogram(&input_latency, "Input-to-photon latency");
+                    break;
+
+                case SDL_SCANCODE_TAB:
+                    // Rewind while held
+                    if (!event->key.repeat) send_command((command_t){ .type = COMMAND_REWIND_START });
+                    break;
+                
+                // Keypad mappings
+                case SDL_SCANCODE_1: send_key(0x1, true); break;
+                case SDL_SCANCODE_2: send_key(0x2, true); break;
+                case SDL_SCANCODE_3: send_key(0x3, true); break;
+                case SDL_SCANCODE_4: send_key(0xC, true); break;
+                case SDL_SCANCODE_Q: send_key(0x4, true); break;
+                case SDL_SCANCODE_W: send_key(0x5, true); break;
+                case SDL_SCANCODE_E: send_key(0x6, true); break;
+                case SDL_SCANCODE_R: send_key(0xD, true); break;
+                case SDL_SCANCODE_A: send_key(0x7, true); break;
+                case SDL_SCANCODE_S: send_key(0x8, true); break;
+                case SDL_SCANCODE_D: send_key(0x9, true); break;
+                case SDL_SCANCODE_F: send_key(0xE, true); break;
+                case SDL_SCANCODE_Z: send_key(0xA, true); break;
+                case SDL_SCANCODE_X: send_key(0x0, true); break;
+                case SDL_SCANCODE_C: send_key(0xB, true); break;
+                case SDL_SCANCODE_V: send_key(0xF, true); break;
+
+                default:
+                    break;
             }
-        } else {
-            // Pixel off, lerp towards background color if not already there
-            if (pixel_colors[i] != bg_color) {
-                pixel_colors[i] = color_lerp(pixel_colors[i], bg_color, color_lerp_rate);
+            break;
+        
+        case SDL_WINDOWEVENT:
+            // Window contents may have been lost
+            if (event->window.event == SDL_WINDOWEVENT_EXPOSED) redraw = true;
+            break;
+
+        case SDL_KEYUP:
+            switch (event->key.keysym.scancode) {
+                case SDL_SCANCODE_TAB: send_command((command_t){ .type = COMMAND_REWIND_STOP }); break;
+
+
+                // Keypad mappings
+                case SDL_SCANCODE_1: send_key(0x1, false); break;
+                case SDL_SCANCODE_2: send_key(0x2, false); break;
+                case SDL_SCANCODE_3: send_key(0x3, false); break;
+                case SDL_SCANCODE_4: send_key(0xC, false); break;
+                case SDL_SCANCODE_Q: send_key(0x4, false); break;
+                case SDL_SCANCODE_W: send_key(0x5, false); break;
+                case SDL_SCANCODE_E: send_key(0x6, false); break;
+                case SDL_SCANCODE_R: send_key(0xD, false); break;
+                case SDL_SCANCODE_A: send_key(0x7, false); break;
+                case SDL_SCANCODE_S: send_key(0x8, false); break;
+                case SDL_SCANCODE_D: send_key(0x9, false); break;
+                case SDL_SCANCODE_F: send_key(0xE, false); break;
+                case SDL_SCANCODE_Z: send_key(0xA, false); break;
+                case SDL_SCANCODE_X: send_key(0x0, false); break;
+                case SDL_SCANCODE_C: send_key(0xB, false); break;
+                case SDL_SCANCODE_V: send_key(0xF, false); break;
+
+                default:
+                    break;
             }
+            break;
+        
+        default:
+            break;
+    }
+}
+
+/**
+ * Wait for an event, then handle every pending one
+ * @param timeout Maximum wait in milliseconds, or -1 to wait indefinitely
+*/
+void handle_events(int32_t timeout) {
+    SDL_Event event;
+    if (!SDL_WaitEventTimeout(&event, timeout)) return;
+
+    do handle_event(&event);
+    while (SDL_PollEvent(&event));
+}
+
+/**
+ * Account for a present
+ * @param frame Frame on screen
+ * @param fresh Whether the frame was new since the previous present
+ * @param start Time the present started
+ * @param end Time the present returned
+*/
+void record_present(const frame_t *frame, bool fresh, uint64_t start, uint64_t end) {
+    if (presents.presents++ == 0) presents.first = end;
+    presents.last = end;
+    add_histogram_sample(&presents.duration, (end - start) * 1000.0 / pacer.freq);
+
+    // A fresh frame should be on screen before the emulation thread publishes the next one
+    if (!fresh) presents.duplicated++;
+    else if (end - frame->time > pacer.freq / CHIP8_FRAME_RATE) presents.missed++;
+}
+
+/**
+ * Print how presents kept up with the emulated frames
+*/
+void print_present_stats() {
+    if (presents.presents == 0) return;
+
+    const char *mode = present_mode == PRESENT_VSYNC ? "vsync" : present_mode == PRESENT_ADAPTIVE ? "adaptive" : "uncapped";
+    const double elapsed = (presents.last - presents.first) / (double)pacer.freq;
+    printf("[INFO] Presents: %llu (%.1f per second, %s), %llu duplicated, %llu dropped frames, %llu missed deadlines\n",
+        (unsigned long long)presents.presents, elapsed > 0 ? (presents.presents - 1) / elapsed : 0.0, mode,
+        (unsigned long long)presents.duplicated, (unsigned long long)presents.dropped, (unsigned long long)presents.missed);
+    print_histogram(&presents.duration, "Present duration");
+}
+
+/**
+ * Fade pixels that have not reached their color and present them, if any
+ * @return Whether pixels are still fading
+*/
+bool update_screen() {
+    // Pixels that toggled in the newest frame start fading towards their new color
+    bool fresh;
+    const frame_t *frame = front_frame(&frames, &fresh);
+    if (fresh) {
+        for (uint32_t y = 0; y < height; y++) {
+            fading_pixels[y] |= frame->display[y] ^ shown_display[y];
+            shown_display[y] = frame->display[y];
+        }
+        if (!presenting_input && frame->input_time > __atomic_load_n(&shown_input, __ATOMIC_RELAXED)) {
+            presenting_input = frame->input_time;
         }
 
-        // Extract current pixel color components
-        uint8_t r, g, b, a;
-        extract_color(pixel_colors[i], &r, &g, &b, &a);
+        // Frames that drew in between were replaced before this thread got to them
+        presents.dropped += frame->draws - presents.draws - frame->drawn;
+        presents.draws = frame->draws;
+    }
 
-        // Update color and draw pixel
-        SDL_SetRenderDrawColor(renderer, r, g, b, a);
-        SDL_RenderFillRect(renderer, &rect);
+    uint32_t first = height, last = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        if (!fading_pixels[y]) continue;
+        if (first == height) first = y;
+        last = y;
+
+        // Each pixel fades towards the foreground color if on, background if off
+        uint32_t *colors = pixel_colors + y * width;
+        uint32_t *targets = target_colors + y * width;
+        for (uint32_t x = 0; x < width; x++) {
+            targets[x] = (shown_display[y] << x >> 63) ? fg_color : bg_color;
+        }
+        fade_colors(colors, targets, width, color_lerp_rate);
 
-        // Draw pixel outline if enabled
-        if (pixel_outline) {
-            SDL_SetRenderDrawColor(renderer, bg_r, bg_g, bg_b, bg_a);
-            SDL_RenderDrawRect(renderer, &rect);
+        // Keep only the pixels that still have not converged
+        uint64_t fading = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            if (colors[x] != targets[x]) fading |= 1ULL << (63 - x);
         }
+        fading_pixels[y] = fading;
+    }
+
+    // Nothing changed on screen
+    if (first == height && !redraw) return false;
+
+    // Upload the changed rows and scale the whole texture to the window in one copy
+    if (first < height) {
+        SDL_Rect rows = { .x = 0, .y = first, .w = width, .h = last - first + 1 };
+        SDL_UpdateTexture(screen_texture, &rows, pixel_colors + first * width, width * sizeof(uint32_t));
     }
+    SDL_RenderCopy(renderer, screen_texture, NULL, NULL);
 
+    // Draw pixel outline if enabled
+    if (pixel_outline) SDL_RenderCopy(renderer, outline_texture, NULL, NULL);
+
+    // Vsync paces presents on the display; uncapped ones are held to the limit
+    if (present_mode == PRESENT_UNCAPPED && presents.presents != 0) {
+        wait_deadline(&pacer, presents.last + pacer.freq / present_limit, SDL_GetPerformanceCounter());
+    }
+
+    const uint64_t start = SDL_GetPerformanceCounter();
     SDL_RenderPresent(renderer);
+    const uint64_t now = SDL_GetPerformanceCounter();
+    record_present(frame, fresh, start, now);
+    redraw = false;
+
+    // Keys land in the histogram once the frame that first shows them is on screen
+    if (presenting_input) {
+        add_histogram_sample(&input_latency, (now - presenting_input) * 1000.0 / pacer.freq);
+        __atomic_store_n(&shown_input, presenting_input, __ATOMIC_RELEASE);
+        presenting_input = 0;
+    }
+
+    for (uint32_t y = 0; y < height; y++) {
+        if (fading_pixels[y]) return true;
+    }
+    return false;
 }
 
 /**
- * Cap framerate to 60 FPS
- * @param diff Main loop execution time difference
+ * Start scheduling frames from the current time
+ * @param scheduler Scheduler
 */
-void cap_framerate(uint64_t diff) {
-    double elapsed = diff / (double)SDL_GetPerformanceFrequency() * 1000.0;
-    double delay = 16.6667 > elapsed ? SDL_floor(16.6667 - elapsed) : 0;
-    SDL_Delay(delay);
+void init_scheduler(scheduler_t *scheduler) {
+    memset(scheduler, 0, sizeof(scheduler_t));
+    scheduler->freq = SDL_GetPerformanceFrequency();
+    scheduler->origin = SDL_GetPerformanceCounter();
+    scheduler->last = scheduler->origin;
 }
 
 /**
- * Update delay and sound timers at 60 Hz
+ * Restart the frame deadlines from the current time
+ * @param scheduler Scheduler
 */
-void update_timers() {
-    // Delay timer
-    if (DT > 0) DT--;
+void resync_scheduler(scheduler_t *scheduler) {
+    scheduler->origin = SDL_GetPerformanceCounter();
+    scheduler->ticks = 0;
+    scheduler->last = scheduler->origin;
+}
 
-    // Sound timer
-    if (ST > 0) {
-        ST--;
-        SDL_PauseAudioDevice(audio, false);
-    } else {
-        SDL_PauseAudioDevice(audio, true);
+/**
+ * Wait for a deadline, sleeping while there is clearly time left and then
+ * spinning for sub-millisecond precision
+ * @param scheduler Scheduler
+ * @param target Deadline in performance counter ticks
+ * @param now Current time
+ * @return Wake time
+*/
+uint64_t wait_deadline(scheduler_t *scheduler, uint64_t target, uint64_t now) {
+    const uint64_t one_ms = scheduler->freq / 1000;
+
+    while (now < target) {
+        const uint64_t remaining = target - now;
+        if (remaining > scheduler->oversleep + one_ms) {
+            const uint64_t requested = remaining - scheduler->oversleep;
+            SDL_Delay((uint32_t)(requested / one_ms));
+
+            const uint64_t woke = SDL_GetPerformanceCounter();
+            const uint64_t slept = woke - now;
+            const uint64_t wanted = requested / one_ms * one_ms;
+            const uint64_t overshoot = slept > wanted ? slept - wanted : 0;
+            scheduler->oversleep = (scheduler->oversleep * 7 + overshoot) / 8;
+            now = woke;
+        } else {
+            now = SDL_GetPerformanceCounter();
+        }
     }
+
+    return now;
+}
+
+/**
+ * Wait for the next 60 Hz deadline; deadlines are absolute, so oversleeping
+ * shortens the following wait instead of accumulating drift
+ * @param scheduler Scheduler
+ * @return Ticks since the previous wake
+*/
+uint64_t wait_frame(scheduler_t *scheduler) {
+    scheduler->ticks++;
+    uint64_t target = scheduler->origin + scheduler->ticks * scheduler->freq / CHIP8_FRAME_RATE;
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    // Far behind (stall): drop the backlog instead of running it in a burst
+    if (now > target + scheduler->freq / 10) {
+        resync_scheduler(scheduler);
+        scheduler->resyncs++;
+        target = now;
+    }
+
+    now = wait_deadline(scheduler, target, now);
+    const uint64_t interval = now - scheduler->last;
+    scheduler->last = now;
+    return interval;
+}
+
+/**
+ * Wait for a slice of the current frame to start; slices split the frame
+ * period evenly, and a slice that is already late starts right away
+ * @param scheduler Scheduler
+ * @param slice Slice number within the frame
+*/
+void wait_slice(scheduler_t *scheduler, uint32_t slice) {
+    const uint64_t per_second = (uint64_t)CHIP8_FRAME_RATE * input_slices;
+    const uint64_t target = scheduler->origin + (scheduler->ticks * input_slices + slice) * scheduler->freq / per_second;
+    wait_deadline(scheduler, target, SDL_GetPerformanceCounter());
+}
+
+/**
+ * Account for an emulated frame
+ * @param scheduler Scheduler
+ * @param interval Ticks since the previous frame
+ * @param insts Instructions run in the frame
+*/
+void record_frame(scheduler_t *scheduler, uint64_t interval, uint32_t insts) {
+    scheduler->frames++;
+    scheduler->insts += insts;
+    scheduler->run_ticks += interval;
+
+    // Deviation from the ideal frame period, in milliseconds
+    const double period = 1000.0 / CHIP8_FRAME_RATE;
+    const double jitter = SDL_fabs(interval * 1000.0 / scheduler->freq - period);
+    scheduler->jitter_sq_sum += jitter * jitter;
+    if (jitter > scheduler->jitter_max) scheduler->jitter_max = jitter;
+}
+
+/**
+ * Print achieved speed and frame pacing
+ * @param scheduler Scheduler
+*/
+void print_scheduler_stats(const scheduler_t *scheduler) {
+    if (scheduler->frames == 0) return;
+
+    const double elapsed = scheduler->run_ticks / (double)scheduler->freq;
+    printf("[INFO] Frames: %llu\n", (unsigned long long)scheduler->frames);
+    printf("[INFO] Achieved instructions per second: %.1f (target %u)\n", scheduler->insts / elapsed, insts_per_sec);
+    printf("[INFO] Frame jitter: %.3f ms RMS, %.3f ms max, %llu resyncs\n",
+        SDL_sqrt(scheduler->jitter_sq_sum / scheduler->frames), scheduler->jitter_max,
+        (unsigned long long)scheduler->resyncs);
+}
+
+/**
+ * Add an event to the movie being recorded, if any
+ * @param type Event type
+ * @param sequence Frames completed
+ * @param offset Instructions completed in the current frame
+ * @param value Key or machine hash
+*/
+void record_event(movie_event_type_t type, uint64_t sequence, uint32_t offset, uint64_t value) {
+    if (!recording) return;
+
+    record_movie_event(recording, type, sequence, sequence * insts_per_sec / CHIP8_FRAME_RATE + offset, value);
+}
+
+/**
+ * Finish the movie being recorded, if any
+ * @param sequence Frames completed
+*/
+void stop_recording(uint64_t sequence) {
+    if (!recording) return;
+
+    if (finish_movie(recording, sequence, &chip8)) {
+        printf("[INFO] Recorded %llu frames to '%s'\n", (unsigned long long)sequence, record_name);
+    }
+    recording = NULL;
+}
+
+/**
+ * Note when a key event reached the machine, unless an older one is still waiting to be shown
+ * @param time Performance counter when the key event was handled
+*/
+void stamp_input(uint64_t time) {
+    if (pending_input && pending_input <= __atomic_load_n(&shown_input, __ATOMIC_ACQUIRE)) pending_input = 0;
+    if (!pending_input) pending_input = time;
+}
+
+/**
+ * Apply input and control commands sent by the main thread. Within a frame only
+ * keys are taken; anything else waits at the head of the queue for the next frame
+ * @param sequence Frames completed
+ * @param offset Instructions completed in the current frame
+ * @return Whether any command was applied
+*/
+bool apply_commands(uint64_t sequence, uint32_t offset) {
+    command_t command;
+    bool applied = false;
+
+    while (peek_command(&commands, &command)) {
+        const bool key = command.type == COMMAND_KEY_DOWN || command.type == COMMAND_KEY_UP;
+        if (offset != 0 && !key) break;
+        pop_command(&commands, &command);
+
+        // Commands that leave the machine alone are still recorded, since they count as input
+        movie_event_type_t event = MOVIE_WAKE;
+
+        switch (command.type) {
+            case COMMAND_KEY_DOWN:
+                chip8.keypad[command.key] = true;
+                stamp_input(command.time);
+                event = MOVIE_KEY_DOWN;
+                break;
+
+            case COMMAND_KEY_UP:
+                chip8.keypad[command.key] = false;
+                stamp_input(command.time);
+                event = MOVIE_KEY_UP;
+                break;
+
+            case COMMAND_RESET:
+                reset_emulator(&chip8);
+                chip8.draw_flag = true;
+                event = MOVIE_RESET;
+                break;
+
+            case COMMAND_SAVE_STATE:
+                // Only the copy happens here; the main thread writes the file
+                if (__atomic_load_n(&save_pending, __ATOMIC_ACQUIRE)) break;
+                save_snapshot(&chip8, &save_buffer);
+                saved_slot = command.slot;
+                __atomic_store_n(&save_pending, true, __ATOMIC_RELEASE);
+                SDL_PushEvent(&(SDL_Event){ .type = snapshot_event });
+                break;
+
+            case COMMAND_LOAD_STATE:
+                // A replay could not follow the jump, so the movie ends here
+                stop_recording(sequence);
+                restore_snapshot(&chip8, &load_buffer);
+                __atomic_store_n(&load_pending, false, __ATOMIC_RELEASE);
+                break;
+
+            case COMMAND_REWIND_START:
+                if (history) stop_recording(sequence);
+                rewinding = history != NULL;
+                break;
+
+            case COMMAND_REWIND_STOP: rewinding = false; break;
+        }
+        record_event(event, sequence, offset, command.key);
+        applied = true;
+    }
+
+    return applied;
+}
+
+/**
+ * Block the emulation thread until the main thread sends something
+*/
+void wait_for_wake() {
+    SDL_SemWait(wake);
+
+    // Every command and state change posts, mostly while nothing waits; the loop
+    // looks at all of them next, so the stale posts must not cut later waits short
+    while (SDL_SemTryWait(wake) == 0) {}
+
+    // Time spent blocked is not owed to the emulator
+    resync_scheduler(&scheduler);
+}
+
+/**
+ * Print how much rewind history is held
+*/
+void print_history_stats() {
+    if (!history) return;
+
+    history_stats_t stats;
+    get_history_stats(history, &stats);
+    printf("[INFO] Rewind history: %llu frames (%.1f s), %llu keyframes, %zu of %zu KiB\n",
+        (unsigned long long)stats.frames, stats.frames / (double)CHIP8_FRAME_RATE,
+        (unsigned long long)stats.keyframes, stats.used >> 10, stats.size >> 10);
+}
+
+/**
+ * Hand the display to the main thread, waking it only when there is something new to draw
+ * @param sequence Frame number
+*/
+void publish_display(uint64_t sequence) {
+    frame_t *frame = back_frame(&frames);
+    memcpy(frame->display, chip8.display, sizeof(frame->display));
+    frame->sequence = sequence;
+
+    // Only frames that draw can show a key; later frames repeat it until it is presented
+    if (pending_input && pending_input <= __atomic_load_n(&shown_input, __ATOMIC_ACQUIRE)) pending_input = 0;
+    frame->input_time = chip8.draw_flag ? pending_input : 0;
+
+    drawn_frames += chip8.draw_flag;
+    frame->draws = drawn_frames;
+    frame->drawn = chip8.draw_flag;
+    frame->time = SDL_GetPerformanceCounter();
+    publish_frame(&frames);
+
+    if (chip8.draw_flag && !__atomic_exchange_n(&frame_pending, true, __ATOMIC_ACQ_REL)) {
+        SDL_PushEvent(&(SDL_Event){ .type = frame_event });
+    }
+    chip8.draw_flag = false;
+}
+
+/**
+ * Run one frame in input_slices parts, waiting for each part's share of the
+ * frame period and applying the keys that arrived in between, so input lands
+ * mid-frame instead of at the next frame. Replays of sliced movies follow the
+ * same parts
+ * @param sequence Frames completed
+ * @param insts Instruction budget of the frame
+ * @param input Whether input arrived since the previous frame
+ * @return Whether the frame ran, false if nothing can change until input arrives
+*/
+bool run_frame(uint64_t sequence, uint32_t insts, bool input) {
+    if (input_slices == 1) return step_frame(&chip8, insts, input);
+    if (!input && is_blocked(&chip8)) return false;
+
+    for (uint32_t slice = 0; slice < input_slices; slice++) {
+        const uint32_t start = slice_offset(insts, input_slices, slice);
+        if (slice > 0) {
+            wait_slice(&scheduler, slice);
+            apply_commands(sequence, start);
+        }
+        emulate_slice(&chip8, slice_offset(insts, input_slices, slice + 1) - start);
+    }
+
+    update_timers(&chip8);
+    return true;
+}
+
+/**
+ * Emulation thread; runs frames at 60 Hz and publishes each one for rendering
+ * @param data Unused
+ * @return Unused
+*/
+int emulation_loop(void *data) {
+    (void)data;
+    uint64_t sequence = 0;
+    bool input = false;
+    init_scheduler(&scheduler);
+
+    while (true) {
+        const uint64_t interval = wait_frame(&scheduler);
+
+        const state_t current = __atomic_load_n(&state, __ATOMIC_RELAXED);
+        if (current == QUIT) break;
+
+        // Input that arrives while paused counts for the next frame that runs, as replays see it
+        input |= apply_commands(sequence, 0);
+        if (current == PAUSED) {
+            // A state loaded or a reset while paused still shows up
+            if (chip8.draw_flag) publish_display(sequence);
+            wait_for_wake();
+            continue;
+        }
+
+        if (rewinding) {
+            // Scrub back one recorded frame per tick; keys held right now stay held
+            bool keypad[16];
+            memcpy(keypad, chip8.keypad, sizeof(keypad));
+            if (!pop_history(history, &chip8)) {
+                wait_for_wake();
+                continue;
+            }
+            memcpy(chip8.keypad, keypad, sizeof(keypad));
+
+            push_synth_frame(synth, false);
+            publish_display(++sequence);
+            continue;
+        }
+
+        // Spread insts_per_sec over the 60 frames of every second
+        const uint32_t budget = frame_budget(insts_per_sec, sequence);
+
+        // Blocked frames are not counted, so replays skip them too
+        if (!run_frame(sequence, budget, input)) {
+            wait_for_wake();
+            continue;
+        }
+        input = false;
+
+        push_synth_frame(synth, chip8.ST != 0);
+        record_frame(&scheduler, interval, budget);
+        if (history) push_history(history, &chip8);
+
+        publish_display(++sequence);
+        if (recording && sequence % MOVIE_CHECKPOINT_INTERVAL == 0) {
+            record_event(MOVIE_CHECKPOINT, sequence, 0, hash_machine(&chip8));
+        }
+    }
+
+    stop_recording(sequence);
+    return 0;
 }
 
 /**
  * Destroy SDL components and quit SDL
 */
 void clean_sdl() {
+    SDL_DestroyTexture(outline_texture);
+    SDL_DestroyTexture(screen_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_CloseAudioDevice(audio);
     SDL_Quit();
+
+    if (synth) {
+        synth_stats_t stats;
+        get_synth_stats(synth, &stats);
+        printf("[INFO] Audio callbacks: %llu, underruns: %llu, late edges: %llu, dropped edges: %llu\n",
+            (unsigned long long)stats.callbacks, (unsigned long long)stats.underruns,
+            (unsigned long long)stats.late_edges, (unsigned long long)stats.dropped_edges);
+        destroy_synth(synth);
+    }
 }
 
+#else
+
 /* -------------------------------------------------------------------------- */
-/*                                  EMULATOR                                  */
+/*                                  HEADLESS                                  */
 /* -------------------------------------------------------------------------- */
 
 /**
- * Load ROM file into memory
- * @param rom_name ROM file name
- * @return Whether loading was successful
+ * Get monotonic clock time
+ * @return Time in seconds
 */
-bool load_rom(char *rom_name) {
-    // Open ROM file
-    FILE *f = fopen(rom_name, "rb");
-    if (!f) {
-        fprintf(stderr, "[ERROR] ROM '%s' not found\n", rom_name);
-        return false;
-    }
-
-    // Get size
-    fseek(f, 0, SEEK_END);
-    const size_t rom_size = ftell(f);
-    const size_t max_size = sizeof(memory) - entry_point;
-    rewind(f);
+double get_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    // Check if size is valid
-    if (rom_size > max_size) {
-        fprintf(stderr, "[ERROR] ROM '%s' is too large\n", rom_name);
-        return false;
-    }
+/**
+ * Hash display contents using 64-bit FNV-1a over the rows packed MSB-first
+ * @param machine Machine instance
+ * @return Framebuffer hash
+*/
+uint64_t display_hash(const chip8_t *machine) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
 
-    // Read into memory
-    if (fread(&memory[entry_point], rom_size, 1, f) != 1) {
-        fprintf(stderr, "[ERROR] Unable to read ROM '%s' into memory\n", rom_name);
-        return false;
+    for (uint32_t y = 0; y < height; y++) {
+        for (int32_t shift = 56; shift >= 0; shift -= 8) {
+            hash ^= (machine->display[y] >> shift) & 0xFF;
+            hash *= 0x100000001B3ULL;
+        }
     }
-    rom = rom_name;
-
-    // Close ROM file
-    fclose(f);
 
-    return true;
+    return hash;
 }
 
 /**
- * Initialize CHIP-8 emulator
- * @param rom_name ROM file name
- * @return Whether initialization was successful
+ * Print display contents and run statistics
+ * @param machine Machine instance whose display is printed
+ * @param frames Number of frames executed per instance
+ * @param insts Number of instructions executed across all instances
+ * @param elapsed Execution time in seconds
 */
-bool init_emulator(char *rom_name) {
-    // Reset emulator
-    memset(&memory[0], 0, sizeof(memory));
-    memset(&V[0], 0, sizeof(V));
-    memset(&stack[0], 0, sizeof(stack));    
-    memset(&display[0], 0, sizeof(display));
-    sp = 0;
-    PC = entry_point;
-    I = 0;
-    DT = 0;
-    ST = 0;
-    draw_flag = false;
-
-    // Load font
-    memcpy(&memory[0], font, sizeof(font));
-
-    // Load ROM file
-    return load_rom(rom_name);
-}
-
-/**
- * Emulate current instruction
-*/
-void emulate_instruction() {
-    // Fetch current opcode and increment PC for next one
-    const uint16_t opcode = (memory[PC] << 8) | memory[PC + 1];
-    PC += 2;
-
-    // Decode instruction
-    const uint16_t NNN = opcode & 0x0FFF;
-    const uint8_t NN = opcode & 0x00FF;
-    const uint8_t N = opcode & 0x000F;
-    const uint8_t X = (opcode & 0x0F00) >> 8;
-    const uint8_t Y = (opcode & 0x00F0) >> 4;
-
-    // Execute instruction
-    debug_print("[DEBUG] Opcode=0x%04X @ PC=0x%04X - ", opcode, PC - 2);
-    switch (opcode >> 12) {
-        case 0x0:
-            switch (NN) {
-                case 0xE0:
-                    // 00E0: clear the screen
-                    debug_print("Clear the screen\n");
-                    memset(&display[0], false, sizeof(display));
-                    draw_flag = true;
-                    break;
-                
-                case 0xEE:
-                    // 00EE: return from subroutine
-                    debug_print("Return from subroutine to PC=0x%04X\n", stack[sp - 1]);
-                    PC = stack[--sp];
-                    break;
-                
-                default:
-                    debug_print("Unimplemented opcode\n");
-                    break;
-            }
-            break;
-        
-        case 0x1:
-            // 1NNN: jump to address NNN
-            debug_print("Jump to NNN=0x%03X\n", NNN);
-            PC = NNN;
-            break;
-        
-        case 0x2:
-            // 2NNN: call subroutine at NNN
-            debug_print("Call subroutine at NNN=0x%03X\n", NNN);
-            stack[sp++] = PC;
-            PC = NNN;
-            break;
-        
-        case 0x3:
-            // 3XNN: skip next instruction if VX == NN
-            debug_print("Skip next instruction if V%01X equals NN=0x%02X (%d)\n", X, NN, V[X] == NN);
-            if (V[X] == NN) PC += 2;
-            break;
-        
-        case 0x4:
-            // 4XNN: skip next instruction if VX != NN
-            debug_print("Skip next instruction if V%01X doesn't equal NN=0x%02X (%d)\n", X, NN, V[X] != NN);
-            if (V[X] != NN) PC += 2;
-            break;
-        
-        case 0x5:
-            // 5XY0: skip next instruction if VX == VY
-            debug_print("Skip next instruction if V%01X equals V%01X (%d)\n", X, Y, V[X] == V[Y]);
-            if (V[X] == V[Y]) PC += 2;
-            break;
-        
-        case 0x6:
-            // 6XNN: set VX to NN
-            debug_print("Set V%01X to NN=0x%02X\n", X, NN);
-            V[X] = NN;
-            break;
-        
-        case 0x7:
-            // 7XNN: add NN to VX
-            debug_print("Add NN=0x%02X to V%01X\n", NN, X);
-            V[X] += NN;
-            break;
-        
-        case 0x8:
-            switch (N) {
-                case 0x0:
-                    // 8XY0: set VX to VY
-                    debug_print("Set V%01X to V%01X\n", X, Y);
-                    V[X] = V[Y];
-                    break;
-                
-                case 0x1:
-                    // 8XY1: set VX to VX OR VY
-                    debug_print("Set V%01X to V%01X OR V%01X\n", X, X, Y);
-                    V[X] |= V[Y];
-                    break;
-                
-                case 0x2:
-                    // 8XY2: set VX to VX AND VY
-                    debug_print("Set V%01X to V%01X AND V%01X\n", X, X, Y);
-                    V[X] &= V[Y];
-                    break;
-                
-                case 0x3:
-                    // 8XY3: set VX to VX XOR VY
-                    debug_print("Set V%01X to V%01X XOR V%01X\n", X, X, Y);
-                    V[X] ^= V[Y];
-                    break;
-                
-                case 0x4:
-                    // 8XY4: add VY to VX; set VF to 1 if carry, and to 0 otherwise
-                    debug_print("Add V%01X to V%01X, set VF to %d\n", Y, X, V[X] + V[Y] > 0xFF);
-                    V[0xF] = (V[X] + V[Y] > 0xFF);
-                    V[X] += V[Y];
-                    break;
-                
-                case 0x5:
-                    // 8XY5: subtract VY from VX; set VF to 0 if borrow, and to 1 otherwise
-                    debug_print("Subtract V%01X from V%01X, set VF to %d\n", Y, X, V[X] > V[Y]);
-                    V[0xF] = V[X] > V[Y];
-                    V[X] -= V[Y];
-                    break;
-                
-                case 0x6:
-                    // 8XY6: right-shift VX by 1; set VF to LSB of VX
-                    debug_print("Right-shift V%01X by 1, set VF to %d\n", X, V[X] & 0xF);
-                    V[0xF] = V[X] & 0xF;
-                    V[X] >>= 1;
-                    break;
-                
-                case 0x7:
-                    // 8XY7: set VX to VY - VX; set VF to 0 if borrow, and to 1 otherwise
-                    debug_print("Set V%01X to V%01X - V%01X, set VF to %d\n", X, Y, X, V[Y] > V[X]);
-                    V[0xF] = V[Y] > V[X];
-                    V[X] = V[Y] - V[X];
-                    break;
-                
-                case 0xE:
-                    // 8XYE: left-shift VX by 1; set VF to MSB of VX
-                    debug_print("Left-shift V%01X by 1, set VF to %d\n", X, V[X] >> 7);
-                    V[0xF] = V[X] >> 7;
-                    V[X] <<= 1;
-                    break;
-                
-                default:
-                    debug_print("Unimplemented opcode\n");
-                    break;
-            }
-            break;
-        
-        case 0x9:
-            // 9XY0: skip next instruction if VX != VY
-            debug_print("Skip next instruction if V%01X doesn't equal V%01X (%d)\n", X, Y, V[X] != V[Y]);
-            if (V[X] != V[Y]) PC += 2;
-            break;
-        
-        case 0xA:
-            // ANNN: set I to address NNN
-            debug_print("Set I to NNN=0x%03X\n", NNN);
-            I = NNN;
-            break;
-        
-        case 0xB:
-            // BNNN: jump to address NNN + V0
-            debug_print("Jump to address NNN=0x%03X + V0 (0x%04X)\n", NNN, NNN + V[0x0]);
-            PC = NNN + V[0x0];
-            break;
-        
-        case 0xC:
-            ;// CXNN: set VX to rand() AND NN
-            uint8_t num = rand() % 256;
-            debug_print("Set VX to rand()=0x%02X AND NN=0x%02X (0x%02X)\n", num, NN, num & NN);
-            V[X] = num & NN;
-            break;
-        
-        case 0xD:
-            // DXYN: draw N-height sprite at coords (VX, VY);
-            // set VF to 1 if any pixel is turned off, and to 0 otherwise
-            debug_print("Draw %u-height sprite at (V%01X, V%01X) from I 0x%04X\n", N, X, Y, I);
+void print_results(const chip8_t *machine, uint64_t frames, uint64_t insts, double elapsed) {
+    // Display contents
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            putchar(machine->display[y] << x >> 63 ? '#' : '.');
+        }
+        putchar('\n');
+    }
 
-            draw_flag = true;
+    // Stats
+    if (instances > 1) printf("[INFO] Instances: %u\n", instances);
+    printf("[INFO] Seed: %llu\n", (unsigned long long)seed);
+    printf("[INFO] Frames: %llu\n", (unsigned long long)frames);
+    printf("[INFO] Instructions: %llu\n", (unsigned long long)insts);
+    printf("[INFO] Elapsed: %.6f s\n", elapsed);
+    printf("[INFO] Instructions per second: %.0f\n", elapsed > 0 ? insts / elapsed : 0);
+    printf("[INFO] Framebuffer hash: 0x%016llX\n", (unsigned long long)display_hash(machine));
+}
 
-            uint8_t x = V[X] % width;
-            uint8_t y = V[Y] % height;
-            const uint8_t original_x = x;
-            
-            V[0xF] = 0;
+/**
+ * Print how much of a batch run ran across lanes
+ * @param batch Batch
+*/
+void print_batch_stats(const batch_t *batch) {
+    batch_stats_t stats;
+    get_batch_stats(batch, &stats);
+
+    const uint64_t total = stats.vectorized + stats.scalar;
+    printf("[INFO] Batch: %s, %.1f%% of lane instructions vectorized, %.2f groups per step\n",
+        stats.avx2 ? "AVX2" : "scalar", total ? stats.vectorized * 100.0 / total : 0,
+        stats.steps ? stats.groups / (double)stats.steps : 0);
+}
 
-            for (uint8_t i = 0; i < N; i++) {
-                const uint8_t sprite_row = memory[I + i];
-                x = original_x;
+/**
+ * Apply a recorded input event to the machine
+ * @param event Event
+*/
+void apply_movie_event(const movie_event_t *event) {
+    switch (event->type) {
+        case MOVIE_KEY_DOWN: chip8.keypad[event->value & 0xF] = true; break;
+        case MOVIE_KEY_UP: chip8.keypad[event->value & 0xF] = false; break;
+        case MOVIE_RESET: reset_emulator(&chip8); break;
+        default: break;
+    }
+}
 
-                for (int8_t j = 7; j >= 0; j--) {
-                    const bool sprite_bit = sprite_row & (1 << j);
-                    bool *display_pixel = &display[y * width + x];
+/**
+ * Apply the input recorded at one point of a frame
+ * @param movie Loaded movie
+ * @param next Index of the next event, moved past the applied ones
+ * @param frame Frames completed
+ * @param inst Instructions completed
+ * @return Whether any event was applied
+*/
+bool apply_movie_events(const movie_t *movie, uint64_t *next, uint64_t frame, uint64_t inst) {
+    const movie_header_t *header = get_movie_header(movie);
+    const movie_event_t *events = get_movie_events(movie);
+    bool applied = false;
+
+    for (; *next < header->events && events[*next].frame == frame && events[*next].inst == inst &&
+        events[*next].type != MOVIE_CHECKPOINT; (*next)++) {
+        apply_movie_event(&events[*next]);
+        applied = true;
+    }
 
-                    if (sprite_bit && *display_pixel) V[0xF] = 1;
+    return applied;
+}
 
-                    *display_pixel ^= sprite_bit;
+/**
+ * Replay a movie uncapped, checking the machine against the recorded checkpoints
+ * @param movie Loaded movie
+ * @return Whether the replay ended in the recorded state
+*/
+bool replay_movie(const movie_t *movie) {
+    const movie_header_t *header = get_movie_header(movie);
+    const movie_event_t *events = get_movie_events(movie);
 
-                    if (++x >= width) break;
-                }
+    if (hash_bytes(chip8.memory, sizeof(chip8.memory)) != header->rom_hash) {
+        fprintf(stderr, "[ERROR] Movie '%s' was recorded with a different ROM\n", replay_name);
+        return false;
+    }
 
-                if (++y >= height) break;
-            }
+    FILE *log = NULL;
+    if (hash_log_name && !(log = fopen(hash_log_name, "w"))) {
+        fprintf(stderr, "[ERROR] Unable to write frame hash log '%s'\n", hash_log_name);
+        return false;
+    }
 
+    uint64_t frames = 0;
+    uint64_t checked = 0; // Frame of the last checkpoint that matched
+    uint64_t next = 0;
+    bool matched = true;
+    const double start = get_time();
+
+    while (matched && frames < header->frames) {
+        const uint64_t first_inst = frames * insts_per_sec / CHIP8_FRAME_RATE;
+        const uint32_t budget = frame_budget(insts_per_sec, frames);
+
+        // Input recorded before this frame
+        const bool input = apply_movie_events(movie, &next, frames, first_inst);
+        const uint64_t end = next < header->events ? events[next].frame : header->frames;
+
+        // A loop waiting on DT runs the same way every frame until DT may let it out
+        uint64_t wait = header->slices == 1 && !input && !log && end > frames ? count_dt_wait(&chip8) : 0;
+        if (wait > end - frames) wait = end - frames;
+
+        if (header->slices == 1 && !input && !log && end > frames && can_skip_idle(&chip8) && (chip8.DT != 0 || chip8.ST != 0)) {
+            // Only the timers can change until the next event, and the recording counted every frame up to it
+            const uint64_t insts = end * insts_per_sec / CHIP8_FRAME_RATE - first_inst;
+            skip_idle_frames(&chip8, end - frames, insts);
+            frames = end;
+        } else if (wait > 0) {
+            skip_dt_wait(&chip8, wait, (frames + wait) * insts_per_sec / CHIP8_FRAME_RATE - first_inst);
+            frames += wait;
+        } else if (!input && is_blocked(&chip8)) {
+            fprintf(stderr, "[ERROR] Replay blocked at frame %llu with no input left to wake it\n", (unsigned long long)frames);
+            matched = false;
             break;
-        
-        case 0xE:
-            switch (NN) {
-                case 0x9E:
-                    // EX9E: skip next instruction if key in VX is pressed
-                    debug_print("Skip next instruction if key in V%01X is pressed (%d)\n", X, keypad[V[X]]);
-                    if (keypad[V[X]]) PC += 2;
-                    break;
-                
-                case 0xA1:
-                    // EXA1: skip next instruction if key in VX isn't pressed
-                    debug_print("Skip next instruction if key in V%01X isn't pressed (%d)\n", X, !keypad[V[X]]);
-                    if (!keypad[V[X]]) PC += 2;
-                    break;
-
-                default:
-                    debug_print("Unimplemented opcode\n");
-                    break;
+        } else if (header->slices == 1) {
+            step_frame(&chip8, budget, input);
+            frames++;
+        } else {
+            // Idle detection starts over with every slice, so sliced recordings are followed slice by slice
+            for (uint32_t slice = 0; slice < header->slices; slice++) {
+                const uint32_t offset = slice_offset(budget, header->slices, slice);
+                if (slice > 0) apply_movie_events(movie, &next, frames, first_inst + offset);
+                emulate_slice(&chip8, slice_offset(budget, header->slices, slice + 1) - offset);
             }
-            break;
-        
-        case 0xF:
-            switch (NN) {
-                case 0x07:
-                    // FX07: set VX to DT
-                    debug_print("Set V%01X to DT=0x%02X\n", X, DT);
-                    V[X] = DT;
-                    break;
-                
-                case 0x0A:
-                    // FX0A: wait for keypress; store it in VX
-                    debug_print("Wait for keypress and store it in V%01X\n", X);
-
-                    static bool key_pressed = false;
-                    static uint8_t key = 0xFF;
-
-                    // Check for keypress
-                    for (uint8_t i = 0; i < 16 && key == 0xFF; i++) {
-                        if (keypad[i]) {
-                            key = i;
-                            key_pressed = true;
-                            break;
-                        }
-                    }
-
-                    // If no key pressed, execute same instruction
-                    if (!key_pressed) PC -= 2;
-                    else {
-                        // If key is still pressed, wait until it's released
-                        if (keypad[key]) PC -= 2;
-                        else {
-                            V[X] = key;
-                            key = 0xFF;
-                            key_pressed = false;
-                        }
-                    }
+            update_timers(&chip8);
+            frames++;
+        }
 
-                    break;
-                
-                case 0x15:
-                    // FX15: set DT to VX
-                    debug_print("Set DT to V%01X\n", X);
-                    DT = V[X];
-                    break;
-                
-                case 0x18:
-                    // FX18: set ST to VX
-                    debug_print("Set ST to V%01X\n", X);
-                    ST = V[X];
-                    break;
-                
-                case 0x1E:
-                    // FX1E: add VX to I
-                    debug_print("Add V%01X to I=0x%04X\n", X, I);
-                    I += V[X];
-                    break;
-                
-                case 0x29:
-                    // FX29: set I to address of sprite for char in VX
-                    debug_print("Set I to sprite adress in V%01X (0x%04X)\n", X, V[X] * 5);
-                    I = V[X] * 5;
-                    break;
-                
-                case 0x33:
-                    // FX33: store BCD representation of VX at locations I, I+1 and I+2
-                    debug_print("Store BCD representation of V%01X at I=%04X, I+1 and I+2\n", X, I);
-                    memory[I] = V[X] / 100;
-                    memory[I + 1] = (V[X] % 100) / 10;
-                    memory[I + 2] = V[X] % 10;
-                    break;
-                
-                case 0x55:
-                    // FX55: store from V0 to VX in memory starting at address I
-                    debug_print("Store from V0 to V%01X in memory starting at I=0x%04X\n", X, I);
-                    for (int i = 0; i <= X; i++) {
-                        memory[I + i] = V[i];
-                    }
-                    break;
+        // Input only ever lands where the recording polled for it
+        if (next < header->events && events[next].frame < frames && events[next].type != MOVIE_CHECKPOINT) {
+            fprintf(stderr, "[ERROR] Event at frame %llu is stamped with instruction %llu\n",
+                (unsigned long long)events[next].frame, (unsigned long long)events[next].inst);
+            matched = false;
+            break;
+        }
 
-                case 0x65:
-                    // FX65: fill from V0 to VX from memory starting at address I
-                    debug_print("Fill from V0 to V%01X from memory starting at I=0x%04X\n", X, I);
-                    for (int i = 0; i <= X; i++) {
-                        V[i] = memory[I + i];
-                    }
-                    break;
+        if (log) fprintf(log, "%llu 0x%016llX\n", (unsigned long long)frames, (unsigned long long)hash_machine(&chip8));
 
-                default:
-                    debug_print("Unimplement opcode\n");
-                    break;
+        for (; next < header->events && events[next].frame == frames && events[next].type == MOVIE_CHECKPOINT; next++) {
+            if (hash_machine(&chip8) != events[next].value) {
+                fprintf(stderr, "[ERROR] Replay diverged from the recording between frames %llu and %llu\n",
+                    (unsigned long long)checked, (unsigned long long)frames);
+                matched = false;
+                break;
             }
-            break;
+            checked = frames;
+        }
+    }
 
-        default:
-            debug_print("Unimplemented opcode\n");
-            break;
+    const double elapsed = get_time() - start;
+    if (log && fclose(log) != 0) {
+        fprintf(stderr, "[ERROR] Unable to write frame hash log '%s'\n", hash_log_name);
+        matched = false;
+    }
+
+    if (matched && hash_machine(&chip8) != header->final_hash) {
+        fprintf(stderr, "[ERROR] Replay diverged from the recording after frame %llu\n", (unsigned long long)checked);
+        matched = false;
     }
+
+    print_results(&chip8, frames, frames * insts_per_sec / CHIP8_FRAME_RATE, elapsed);
+    if (matched) printf("[INFO] Replay matches the recording\n");
+    return matched;
 }
 
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                                    MAIN                                    */
 /* -------------------------------------------------------------------------- */
@@ -896,38 +1627,195 @@ void emulate_instruction() {
 */
 int main(int argc, char **argv) {
     if (!set_config(argc, argv)) return EXIT_FAILURE;
-    if (!init_emulator(args_rom)) return EXIT_FAILURE;
-    if (!init_sdl()) return EXIT_FAILURE;
 
-    // Initialize random number generator
-    srand(time(NULL));
+#ifdef HEADLESS
+    // Replays run with the seed and speed they were recorded with
+    movie_t *replay = NULL;
+    if (replay_name) {
+        replay = open_movie(replay_name);
+        if (!replay) return EXIT_FAILURE;
 
-    // Main loop
-    while (state != QUIT) {
-        handle_events();
+        seed = get_movie_header(replay)->seed;
+        insts_per_sec = get_movie_header(replay)->insts_per_sec;
+    }
+#endif
+
+    chip8.seed = seed;
+    if (!init_emulator(&chip8, args_rom)) return EXIT_FAILURE;
+    if (!init_engine(&chip8)) return EXIT_FAILURE;
+#ifdef TRACE
+    if (!open_trace(trace_name, trace_capacity)) return EXIT_FAILURE;
+#endif
+
+#ifdef HEADLESS
+    uint64_t frames = 0;
+    uint64_t insts = 0;
+
+    if (replay) {
+        const bool matched = replay_movie(replay);
+        destroy_movie(replay);
+
+        const bool diverged = jit_diverged(&chip8);
+        destroy_jit(&chip8);
+        if (!matched || diverged) return EXIT_FAILURE;
+    } else if (instances > 1 || engine == BATCH || engine == BATCH_DIFF) {
+        // Run every instance for the frame limit, across the worker pool or as lanes of one batch.
+        // Instances get consecutive seeds, so runs that use CXNN spread out
+        const bool batched = engine == BATCH || engine == BATCH_DIFF;
+        chip8_t *machines = malloc(instances * sizeof(chip8_t));
+        pool_t *pool = engine != BATCH ? create_pool(threads) : NULL;
+        if (!machines || (!pool && engine != BATCH)) {
+            fprintf(stderr, "[ERROR] Unable to allocate %u instances\n", instances);
+            return EXIT_FAILURE;
+        }
 
-        if (state == PAUSED) continue;
+        for (uint32_t i = 0; i < instances; i++) {
+            machines[i] = chip8;
+            machines[i].seed = seed + i;
+            if (!init_engine(&machines[i])) return EXIT_FAILURE;
+            reset_emulator(&machines[i]);
+        }
 
-        uint64_t start = SDL_GetPerformanceCounter();
-        // Execute number of instructions every second at 60 Hz
-        for (uint32_t i = 0; i < insts_per_sec / 60; i++) {
-            emulate_instruction();
+        batch_t *batch = batched ? create_batch(machines, instances) : NULL;
+        if (batched && !batch) {
+            fprintf(stderr, "[ERROR] Unable to allocate %u instances\n", instances);
+            return EXIT_FAILURE;
         }
-        uint64_t end = SDL_GetPerformanceCounter();
 
-        cap_framerate(end - start);
+        const double start = get_time();
+        if (batch) run_batch(batch, max_frames, insts_per_sec);
+        else run_pool(pool, machines, instances, max_frames, insts_per_sec);
+        const double elapsed = get_time() - start;
+
+        frames = max_frames;
+        insts = frames * insts_per_sec / CHIP8_FRAME_RATE * instances;
+        print_results(batch ? get_batch_lane(batch, 0) : &machines[0], frames, insts, elapsed);
+        if (batch) print_batch_stats(batch);
+
+        bool diverged = false;
+        if (engine == BATCH_DIFF) {
+            // Check every lane against the same machine run on its own through the interpreter
+            run_pool(pool, machines, instances, max_frames, insts_per_sec);
+            for (uint32_t i = 0; i < instances; i++) {
+                if (hash_machine(get_batch_lane(batch, i)) != hash_machine(&machines[i])) {
+                    fprintf(stderr, "[ERROR] Batch lane %u diverged from the interpreter\n", i);
+                    diverged = true;
+                }
+            }
+        }
 
-        if (draw_flag) {
-            update_screen();
+        for (uint32_t i = 0; i < instances; i++) {
+            diverged |= jit_diverged(&machines[i]);
+            destroy_jit(&machines[i]);
+        }
 
-            // Reset draw flag
-            draw_flag = false;
+        destroy_batch(batch);
+        destroy_pool(pool);
+        free(machines);
+        destroy_jit(&chip8);
+        return diverged ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else {
+        const double start = get_time();
+
+        // Run uncapped until either limit is reached
+        while ((max_frames == 0 || frames < max_frames) && (max_insts == 0 || insts < max_insts)) {
+            uint32_t budget = frame_budget(insts_per_sec, frames);
+            if (max_insts != 0 && max_insts - insts < budget) budget = max_insts - insts;
+
+            emulate_frame(&chip8, budget);
+            insts += budget;
+            frames++;
+
+            uint64_t end = max_frames != 0 ? max_frames : UINT64_MAX;
+            if (max_insts != 0) {
+                // Last frame whose whole budget still fits in the instruction limit
+                const uint64_t fits = ((max_insts + 1) * CHIP8_FRAME_RATE - 1) / insts_per_sec;
+                if (fits < end) end = fits;
+            }
+            if (end <= frames) continue;
+
+            if (can_skip_idle(&chip8)) {
+                // Nothing but the timers can change any more; jump to the end of the run
+                const uint64_t skipped = end * insts_per_sec / CHIP8_FRAME_RATE - insts;
+                skip_idle_frames(&chip8, end - frames, skipped);
+                insts += skipped;
+                frames = end;
+            } else {
+                // A loop waiting on DT; jump to the frame that may leave it
+                uint64_t wait = count_dt_wait(&chip8);
+                if (wait > end - frames) wait = end - frames;
+                if (wait > 0) {
+                    const uint64_t skipped = (frames + wait) * insts_per_sec / CHIP8_FRAME_RATE - insts;
+                    skip_dt_wait(&chip8, wait, skipped);
+                    insts += skipped;
+                    frames += wait;
+                }
+            }
         }
 
-        update_timers();
+        print_results(&chip8, frames, insts, get_time() - start);
+
+        const bool diverged = jit_diverged(&chip8);
+        destroy_jit(&chip8);
+        if (diverged) return EXIT_FAILURE;
     }
+#else
+    if (!init_sdl()) return EXIT_FAILURE;
+    init_scheduler(&pacer);
 
+    if (rewind_memory != 0) {
+        history = create_history((size_t)rewind_memory << 20);
+        if (!history) {
+            fprintf(stderr, "[ERROR] Unable to allocate %u MiB of rewind history\n", rewind_memory);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Recording starts from the freshly loaded ROM, so a replay only needs the seed and the input
+    printf("[INFO] Seed: %llu\n", (unsigned long long)seed);
+    if (record_name) {
+        recording = create_movie(record_name, &chip8, insts_per_sec, input_slices);
+        if (!recording) return EXIT_FAILURE;
+    }
+
+    init_triple_buffer(&frames);
+    init_command_queue(&commands);
+    frame_event = SDL_RegisterEvents(2);
+    snapshot_event = frame_event + 1;
+    wake = SDL_CreateSemaphore(0);
+    emulation = wake && frame_event != (uint32_t)-1 ? SDL_CreateThread(emulation_loop, "emulation", NULL) : NULL;
+    if (!emulation) {
+        fprintf(stderr, "[ERROR] Unable to start emulation thread: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    // Main loop; sleeps until input or a new frame arrives, or the next fade step is due
+    bool animating = true;
+    while (state != QUIT) {
+        handle_events(animating ? 16 : -1);
+
+        __atomic_store_n(&frame_pending, false, __ATOMIC_RELEASE);
+        animating = update_screen();
+    }
+
+    SDL_WaitThread(emulation, NULL);
+    SDL_DestroySemaphore(wake);
+    print_scheduler_stats(&scheduler);
+    print_present_stats();
+    printf("[INFO] Dropped commands: %llu\n", (unsigned long long)dropped_commands);
+    print_histogram(&input_latency, "Input-to-photon latency");
+    print_history_stats();
     clean_sdl();
+    destroy_jit(&chip8);
+    destroy_history(history);
+#endif
+
+#ifdef PROFILE
+    if (!write_profile(&chip8, profile_report_name, profile_folded_name)) return EXIT_FAILURE;
+#endif
+#ifdef TRACE
+    close_trace();
+#endif
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1249 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "emulator.h"
+#include "jit.h"
+
+#ifdef PROFILE
+#include "profile.h"
+#endif
+
+#ifdef TRACE
+#include "trace.h"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                   MACROS                                   */
+/* -------------------------------------------------------------------------- */
+
+#ifdef DEBUG
+#define debug_print(...) do { printf(__VA_ARGS__); } while (false)
+#else
+#define debug_print(...) do {} while (false)
+#endif
+
+#define debug_prefix(inst, pc) debug_print("[DEBUG] Opcode=0x%04X @ PC=0x%04X - ", (inst)->opcode, (pc))
+
+#ifdef PROFILE
+#define profile_hook(inst, pc) profile_instruction((pc), (inst)->opcode)
+#else
+#define profile_hook(inst, pc) do {} while (false)
+#endif
+
+#ifdef TRACE
+#define trace_hook(chip8, pc, opcode) trace_instruction((chip8), (pc), (opcode))
+#else
+#define trace_hook(chip8, pc, opcode) do { (void)(opcode); } while (false)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+const uint8_t font[] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+const uint8_t idle_max_backoff = 64;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+void op_decode(chip8_t *chip8, const decoded_t *inst);
+
+/* -------------------------------------------------------------------------- */
+/*                                  EMULATOR                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Build the boot image from a ROM already in memory, after the font; the
+ * machine keeps running its current memory until the next reset
+ * @param chip8 Machine instance
+ * @param rom ROM bytes
+ * @param rom_size ROM size in bytes
+ * @return Whether the ROM fits after the entry point
+*/
+bool load_rom_buffer(chip8_t *chip8, const uint8_t *rom, size_t rom_size) {
+    if (rom_size > sizeof(chip8->boot) - CHIP8_ENTRY_POINT) return false;
+
+    memset(chip8->boot, 0, sizeof(chip8->boot));
+    memcpy(chip8->boot, font, sizeof(font));
+    if (rom_size > 0) memcpy(&chip8->boot[CHIP8_ENTRY_POINT], rom, rom_size);
+    chip8->rom = NULL;
+
+    // Nothing decoded so far came from this image
+    chip8->dirty_start = 0;
+    chip8->dirty_end = sizeof(chip8->memory);
+
+    return true;
+}
+
+/**
+ * Load ROM file into the boot image, after the font; the machine keeps
+ * running its current memory until the next reset
+ * @param chip8 Machine instance
+ * @param rom_name ROM file name
+ * @return Whether loading was successful
+*/
+bool load_rom(chip8_t *chip8, const char *rom_name) {
+    // Open ROM file
+    const int fd = open(rom_name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "[ERROR] ROM '%s' not found\n", rom_name);
+        return false;
+    }
+
+    // Check if size is valid
+    const size_t rom_size = st.st_size;
+    if (rom_size > sizeof(chip8->boot) - CHIP8_ENTRY_POINT) {
+        close(fd);
+        fprintf(stderr, "[ERROR] ROM '%s' is too large\n", rom_name);
+        return false;
+    }
+
+    // Map it just long enough to copy it
+    void *rom = rom_size > 0 ? mmap(NULL, rom_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (rom == MAP_FAILED) {
+        fprintf(stderr, "[ERROR] Unable to read ROM '%s' into memory\n", rom_name);
+        return false;
+    }
+
+    load_rom_buffer(chip8, rom, rom_size);
+    munmap(rom, rom_size);
+    chip8->rom = rom_name;
+
+    return true;
+}
+
+/**
+ * Reset the machine to the boot image; only the memory written since the
+ * last reset has its predecoded and translated instructions dropped
+ * @param chip8 Machine instance with a ROM loaded
+*/
+void reset_emulator(chip8_t *chip8) {
+    memcpy(chip8->memory, chip8->boot, sizeof(chip8->memory));
+    memset(chip8->V, 0, sizeof(chip8->V));
+    memset(chip8->stack, 0, sizeof(chip8->stack));
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->sp = 0;
+    chip8->PC = CHIP8_ENTRY_POINT;
+    chip8->I = 0;
+    chip8->DT = 0;
+    chip8->ST = 0;
+    chip8->draw_flag = false;
+    chip8->key_pressed = false;
+    chip8->key_wait = false;
+    chip8->key = 0xFF;
+    chip8->rng = chip8->seed;
+    chip8->idle.active = false;
+
+    if (chip8->dirty_end > chip8->dirty_start) {
+        invalidate_decoded(chip8, chip8->dirty_start, chip8->dirty_end - chip8->dirty_start);
+    }
+    chip8->dirty_start = sizeof(chip8->memory);
+    chip8->dirty_end = 0;
+}
+
+/**
+ * Initialize CHIP-8 emulator
+ * @param chip8 Machine instance
+ * @param rom_name ROM file name
+ * @return Whether initialization was successful
+*/
+bool init_emulator(chip8_t *chip8, const char *rom_name) {
+    if (!load_rom(chip8, rom_name)) return false;
+
+    reset_emulator(chip8);
+    return true;
+}
+
+/**
+ * Update delay and sound timers at 60 Hz
+ * @param chip8 Machine instance
+*/
+void update_timers(chip8_t *chip8) {
+    // Delay timer
+    if (chip8->DT > 0) chip8->DT--;
+
+    // Sound timer
+    if (chip8->ST > 0) chip8->ST--;
+}
+
+/**
+ * Next byte of the machine's random sequence (splitmix64)
+ * @param chip8 Machine instance
+ * @return Random byte
+*/
+uint8_t random_byte(chip8_t *chip8) {
+    uint64_t z = (chip8->rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint8_t)((z ^ (z >> 31)) >> 56);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                INSTRUCTIONS                                */
+/* -------------------------------------------------------------------------- */
+
+// All handlers run with PC already pointing at the next instruction
+
+/**
+ * Placeholder for unknown opcodes
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_unknown(chip8_t *chip8, const decoded_t *inst) {
+    (void)chip8;
+    (void)inst;
+    debug_print("Unimplemented opcode\n");
+}
+
+/**
+ * 00E0: clear the screen
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_00E0(chip8_t *chip8, const decoded_t *inst) {
+    (void)inst;
+    debug_print("Clear the screen\n");
+    chip8->effects++;
+    memset(&chip8->display[0], false, sizeof(chip8->display));
+    chip8->draw_flag = true;
+}
+
+/**
+ * 00EE: return from subroutine
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_00EE(chip8_t *chip8, const decoded_t *inst) {
+    (void)inst;
+    debug_print("Return from subroutine to PC=0x%04X\n", chip8->stack[chip8->sp - 1]);
+    chip8->effects++;
+    chip8->PC = chip8->stack[--chip8->sp];
+}
+
+/**
+ * 1NNN: jump to address NNN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Jump to NNN=0x%03X\n", inst->NNN);
+    chip8->PC = inst->NNN;
+}
+
+/**
+ * 2NNN: call subroutine at NNN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_2NNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Call subroutine at NNN=0x%03X\n", inst->NNN);
+    chip8->effects++;
+    chip8->stack[chip8->sp++] = chip8->PC;
+    chip8->PC = inst->NNN;
+}
+
+/**
+ * 3XNN: skip next instruction if VX == NN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_3XNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if V%01X equals NN=0x%02X (%d)\n", inst->X, inst->NN, chip8->V[inst->X] == inst->NN);
+    if (chip8->V[inst->X] == inst->NN) chip8->PC += 2;
+}
+
+/**
+ * 4XNN: skip next instruction if VX != NN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_4XNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if V%01X doesn't equal NN=0x%02X (%d)\n", inst->X, inst->NN, chip8->V[inst->X] != inst->NN);
+    if (chip8->V[inst->X] != inst->NN) chip8->PC += 2;
+}
+
+/**
+ * 5XY0: skip next instruction if VX == VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_5XY0(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if V%01X equals V%01X (%d)\n", inst->X, inst->Y, chip8->V[inst->X] == chip8->V[inst->Y]);
+    if (chip8->V[inst->X] == chip8->V[inst->Y]) chip8->PC += 2;
+}
+
+/**
+ * 6XNN: set VX to NN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_6XNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to NN=0x%02X\n", inst->X, inst->NN);
+    chip8->V[inst->X] = inst->NN;
+}
+
+/**
+ * 7XNN: add NN to VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_7XNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Add NN=0x%02X to V%01X\n", inst->NN, inst->X);
+    chip8->V[inst->X] += inst->NN;
+}
+
+/**
+ * 8XY0: set VX to VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY0(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to V%01X\n", inst->X, inst->Y);
+    chip8->V[inst->X] = chip8->V[inst->Y];
+}
+
+/**
+ * 8XY1: set VX to VX OR VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY1(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to V%01X OR V%01X\n", inst->X, inst->X, inst->Y);
+    chip8->V[inst->X] |= chip8->V[inst->Y];
+}
+
+/**
+ * 8XY2: set VX to VX AND VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY2(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to V%01X AND V%01X\n", inst->X, inst->X, inst->Y);
+    chip8->V[inst->X] &= chip8->V[inst->Y];
+}
+
+/**
+ * 8XY3: set VX to VX XOR VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY3(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to V%01X XOR V%01X\n", inst->X, inst->X, inst->Y);
+    chip8->V[inst->X] ^= chip8->V[inst->Y];
+}
+
+/**
+ * 8XY4: add VY to VX; set VF to 1 if carry, and to 0 otherwise
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY4(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t *V = chip8->V;
+    debug_print("Add V%01X to V%01X, set VF to %d\n", inst->Y, inst->X, V[inst->X] + V[inst->Y] > 0xFF);
+    V[0xF] = (V[inst->X] + V[inst->Y] > 0xFF);
+    V[inst->X] += V[inst->Y];
+}
+
+/**
+ * 8XY5: subtract VY from VX; set VF to 0 if borrow, and to 1 otherwise
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY5(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t *V = chip8->V;
+    debug_print("Subtract V%01X from V%01X, set VF to %d\n", inst->Y, inst->X, V[inst->X] > V[inst->Y]);
+    V[0xF] = V[inst->X] > V[inst->Y];
+    V[inst->X] -= V[inst->Y];
+}
+
+/**
+ * 8XY6: right-shift VX by 1; set VF to LSB of VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY6(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t *V = chip8->V;
+    debug_print("Right-shift V%01X by 1, set VF to %d\n", inst->X, V[inst->X] & 0xF);
+    V[0xF] = V[inst->X] & 0xF;
+    V[inst->X] >>= 1;
+}
+
+/**
+ * 8XY7: set VX to VY - VX; set VF to 0 if borrow, and to 1 otherwise
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XY7(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t *V = chip8->V;
+    debug_print("Set V%01X to V%01X - V%01X, set VF to %d\n", inst->X, inst->Y, inst->X, V[inst->Y] > V[inst->X]);
+    V[0xF] = V[inst->Y] > V[inst->X];
+    V[inst->X] = V[inst->Y] - V[inst->X];
+}
+
+/**
+ * 8XYE: left-shift VX by 1; set VF to MSB of VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_8XYE(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t *V = chip8->V;
+    debug_print("Left-shift V%01X by 1, set VF to %d\n", inst->X, V[inst->X] >> 7);
+    V[0xF] = V[inst->X] >> 7;
+    V[inst->X] <<= 1;
+}
+
+/**
+ * 9XY0: skip next instruction if VX != VY
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_9XY0(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if V%01X doesn't equal V%01X (%d)\n", inst->X, inst->Y, chip8->V[inst->X] != chip8->V[inst->Y]);
+    if (chip8->V[inst->X] != chip8->V[inst->Y]) chip8->PC += 2;
+}
+
+/**
+ * ANNN: set I to address NNN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_ANNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set I to NNN=0x%03X\n", inst->NNN);
+    chip8->I = inst->NNN;
+}
+
+/**
+ * BNNN: jump to address NNN + V0
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_BNNN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Jump to address NNN=0x%03X + V0 (0x%04X)\n", inst->NNN, inst->NNN + chip8->V[0x0]);
+    chip8->PC = inst->NNN + chip8->V[0x0];
+}
+
+/**
+ * CXNN: set VX to a random number AND NN
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_CXNN(chip8_t *chip8, const decoded_t *inst) {
+    uint8_t num = random_byte(chip8);
+    debug_print("Set VX to rand()=0x%02X AND NN=0x%02X (0x%02X)\n", num, inst->NN, num & inst->NN);
+    chip8->effects++;
+    chip8->V[inst->X] = num & inst->NN;
+}
+
+/**
+ * DXYN: draw N-height sprite at coords (VX, VY);
+ * set VF to 1 if any pixel is turned off, and to 0 otherwise
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_DXYN(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Draw %u-height sprite at (V%01X, V%01X) from I 0x%04X\n", inst->N, inst->X, inst->Y, chip8->I);
+    chip8->effects++;
+
+    chip8->draw_flag = true;
+
+    const uint8_t x = chip8->V[inst->X] % CHIP8_WIDTH;
+    const uint8_t y = chip8->V[inst->Y] % CHIP8_HEIGHT;
+    uint64_t collision = 0;
+
+    // Rows past the bottom edge are clipped; shifting right drops the
+    // columns past the right edge
+    for (uint8_t i = 0; i < inst->N && y + i < CHIP8_HEIGHT; i++) {
+        const uint64_t sprite_row = (uint64_t)chip8->memory[chip8->I + i] << (CHIP8_WIDTH - 8) >> x;
+        collision |= chip8->display[y + i] & sprite_row;
+        chip8->display[y + i] ^= sprite_row;
+    }
+
+    chip8->V[0xF] = collision != 0;
+}
+
+/**
+ * EX9E: skip next instruction if key in VX is pressed
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_EX9E(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if key in V%01X is pressed (%d)\n", inst->X, chip8->keypad[chip8->V[inst->X]]);
+    chip8->reads |= CHIP8_READS_KEYS;
+    if (chip8->keypad[chip8->V[inst->X]]) chip8->PC += 2;
+}
+
+/**
+ * EXA1: skip next instruction if key in VX isn't pressed
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_EXA1(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Skip next instruction if key in V%01X isn't pressed (%d)\n", inst->X, !chip8->keypad[chip8->V[inst->X]]);
+    chip8->reads |= CHIP8_READS_KEYS;
+    if (!chip8->keypad[chip8->V[inst->X]]) chip8->PC += 2;
+}
+
+/**
+ * FX07: set VX to DT
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX07(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set V%01X to DT=0x%02X\n", inst->X, chip8->DT);
+    chip8->reads |= CHIP8_READS_DT;
+    chip8->V[inst->X] = chip8->DT;
+}
+
+/**
+ * FX0A: wait for keypress; store it in VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX0A(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Wait for keypress and store it in V%01X\n", inst->X);
+    chip8->effects++;
+
+    // Check for keypress
+    for (uint8_t i = 0; i < 16 && chip8->key == 0xFF; i++) {
+        if (chip8->keypad[i]) {
+            chip8->key = i;
+            chip8->key_pressed = true;
+            break;
+        }
+    }
+
+    // If no key pressed, execute same instruction
+    chip8->key_wait = true;
+    if (!chip8->key_pressed) chip8->PC -= 2;
+    else {
+        // If key is still pressed, wait until it's released
+        if (chip8->keypad[chip8->key]) chip8->PC -= 2;
+        else {
+            chip8->V[inst->X] = chip8->key;
+            chip8->key = 0xFF;
+            chip8->key_pressed = false;
+            chip8->key_wait = false;
+        }
+    }
+}
+
+/**
+ * FX15: set DT to VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX15(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set DT to V%01X\n", inst->X);
+    chip8->effects++;
+    chip8->DT = chip8->V[inst->X];
+}
+
+/**
+ * FX18: set ST to VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX18(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set ST to V%01X\n", inst->X);
+    chip8->effects++;
+    chip8->ST = chip8->V[inst->X];
+}
+
+/**
+ * FX1E: add VX to I
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX1E(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Add V%01X to I=0x%04X\n", inst->X, chip8->I);
+    chip8->I += chip8->V[inst->X];
+}
+
+/**
+ * FX29: set I to address of sprite for char in VX
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX29(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Set I to sprite adress in V%01X (0x%04X)\n", inst->X, chip8->V[inst->X] * 5);
+    chip8->I = chip8->V[inst->X] * 5;
+}
+
+/**
+ * FX33: store BCD representation of VX at locations I, I+1 and I+2
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX33(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Store BCD representation of V%01X at I=%04X, I+1 and I+2\n", inst->X, chip8->I);
+    chip8->effects++;
+    chip8->memory[chip8->I] = chip8->V[inst->X] / 100;
+    chip8->memory[chip8->I + 1] = (chip8->V[inst->X] % 100) / 10;
+    chip8->memory[chip8->I + 2] = chip8->V[inst->X] % 10;
+    invalidate_decoded(chip8, chip8->I, 3);
+}
+
+/**
+ * FX55: store from V0 to VX in memory starting at address I
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX55(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Store from V0 to V%01X in memory starting at I=0x%04X\n", inst->X, chip8->I);
+    chip8->effects++;
+    for (int i = 0; i <= inst->X; i++) {
+        chip8->memory[chip8->I + i] = chip8->V[i];
+    }
+    invalidate_decoded(chip8, chip8->I, inst->X + 1);
+}
+
+/**
+ * FX65: fill from V0 to VX from memory starting at address I
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction
+*/
+void op_FX65(chip8_t *chip8, const decoded_t *inst) {
+    debug_print("Fill from V0 to V%01X from memory starting at I=0x%04X\n", inst->X, chip8->I);
+    for (int i = 0; i <= inst->X; i++) {
+        chip8->V[i] = chip8->memory[chip8->I + i];
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              SUPERINSTRUCTIONS                             */
+/* -------------------------------------------------------------------------- */
+
+// Fused handlers run with PC still pointing at the first instruction and
+// return how many instructions they executed, since a taken skip stops early
+
+/**
+ * Run a skip followed by a jump: skip over the jump if the condition holds,
+ * otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @param skip Handler of the skip instruction
+ * @return Number of instructions executed
+*/
+uint32_t run_skip_jump(chip8_t *chip8, const decoded_t *inst, handler_t skip) {
+    const uint16_t pc = chip8->PC;
+    debug_prefix(&inst[0], pc);
+    chip8->PC += 2;
+    skip(chip8, &inst[0]);
+    if (chip8->PC != pc + 2) return 1;
+
+    debug_prefix(&inst[1], chip8->PC);
+    op_1NNN(chip8, &inst[1]);
+    return 2;
+}
+
+/**
+ * 3XNN + 1NNN: skip over the jump if VX == NN, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_3XNN_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_3XNN);
+}
+
+/**
+ * 4XNN + 1NNN: skip over the jump if VX != NN, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_4XNN_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_4XNN);
+}
+
+/**
+ * 5XY0 + 1NNN: skip over the jump if VX == VY, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_5XY0_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_5XY0);
+}
+
+/**
+ * 9XY0 + 1NNN: skip over the jump if VX != VY, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_9XY0_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_9XY0);
+}
+
+/**
+ * EX9E + 1NNN: skip over the jump if key in VX is pressed, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_EX9E_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_EX9E);
+}
+
+/**
+ * EXA1 + 1NNN: skip over the jump if key in VX isn't pressed, otherwise take it
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_EXA1_1NNN(chip8_t *chip8, const decoded_t *inst) {
+    return run_skip_jump(chip8, inst, op_EXA1);
+}
+
+/**
+ * 6XNN + DXYN: set a register and draw a sprite
+ * @param chip8 Machine instance
+ * @param inst Decoded instruction pair
+ * @return Number of instructions executed
+*/
+uint32_t op_6XNN_DXYN(chip8_t *chip8, const decoded_t *inst) {
+    debug_prefix(&inst[0], chip8->PC);
+    chip8->PC += 2;
+    op_6XNN(chip8, &inst[0]);
+
+    debug_prefix(&inst[1], chip8->PC);
+    chip8->PC += 2;
+    op_DXYN(chip8, &inst[1]);
+    return 2;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   DECODER                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Decode an opcode into its handler and operands
+ * @param opcode Raw opcode
+ * @param inst Decoded instruction to fill
+*/
+void decode_instruction(uint16_t opcode, decoded_t *inst) {
+    *inst = (decoded_t){
+        .handler = op_unknown,
+        .fused = NULL,
+        .opcode = opcode,
+        .NNN = opcode & 0x0FFF,
+        .NN = opcode & 0x00FF,
+        .N = opcode & 0x000F,
+        .X = (opcode & 0x0F00) >> 8,
+        .Y = (opcode & 0x00F0) >> 4,
+    };
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (inst->NN == 0xE0) inst->handler = op_00E0;
+            else if (inst->NN == 0xEE) inst->handler = op_00EE;
+            break;
+
+        case 0x1: inst->handler = op_1NNN; break;
+        case 0x2: inst->handler = op_2NNN; break;
+        case 0x3: inst->handler = op_3XNN; break;
+        case 0x4: inst->handler = op_4XNN; break;
+        case 0x5: inst->handler = op_5XY0; break;
+        case 0x6: inst->handler = op_6XNN; break;
+        case 0x7: inst->handler = op_7XNN; break;
+
+        case 0x8:
+            switch (inst->N) {
+                case 0x0: inst->handler = op_8XY0; break;
+                case 0x1: inst->handler = op_8XY1; break;
+                case 0x2: inst->handler = op_8XY2; break;
+                case 0x3: inst->handler = op_8XY3; break;
+                case 0x4: inst->handler = op_8XY4; break;
+                case 0x5: inst->handler = op_8XY5; break;
+                case 0x6: inst->handler = op_8XY6; break;
+                case 0x7: inst->handler = op_8XY7; break;
+                case 0xE: inst->handler = op_8XYE; break;
+                default: break;
+            }
+            break;
+
+        case 0x9: inst->handler = op_9XY0; break;
+        case 0xA: inst->handler = op_ANNN; break;
+        case 0xB: inst->handler = op_BNNN; break;
+        case 0xC: inst->handler = op_CXNN; break;
+        case 0xD: inst->handler = op_DXYN; break;
+
+        case 0xE:
+            if (inst->NN == 0x9E) inst->handler = op_EX9E;
+            else if (inst->NN == 0xA1) inst->handler = op_EXA1;
+            break;
+
+        case 0xF:
+            switch (inst->NN) {
+                case 0x07: inst->handler = op_FX07; break;
+                case 0x0A: inst->handler = op_FX0A; break;
+                case 0x15: inst->handler = op_FX15; break;
+                case 0x18: inst->handler = op_FX18; break;
+                case 0x1E: inst->handler = op_FX1E; break;
+                case 0x29: inst->handler = op_FX29; break;
+                case 0x33: inst->handler = op_FX33; break;
+                case 0x55: inst->handler = op_FX55; break;
+                case 0x65: inst->handler = op_FX65; break;
+                default: break;
+            }
+            break;
+    }
+}
+
+/**
+ * Fetch and decode the instruction at an even address into the cache,
+ * fusing it with the following instruction when a superinstruction exists
+ * @param chip8 Machine instance
+ * @param index Cache index (address / 2)
+*/
+void decode_entry(chip8_t *chip8, uint32_t index) {
+    const uint32_t addr = index * 2;
+    decoded_t *inst = &chip8->decoded[index];
+    decode_instruction((chip8->memory[addr] << 8) | chip8->memory[addr + 1], inst);
+
+    if (index + 1 >= CHIP8_DECODED_SIZE) return;
+
+#if defined(PROFILE) || defined(TRACE)
+    // Every instruction has to go through emulate_instruction to be seen
+    return;
+#endif
+
+    // Peek at the next instruction and pick a fused handler for the pair
+    const uint16_t next = (chip8->memory[addr + 2] << 8) | chip8->memory[addr + 3];
+    fused_handler_t fused = NULL;
+
+    if ((next >> 12) == 0x1) {
+        if (inst->handler == op_3XNN) fused = op_3XNN_1NNN;
+        else if (inst->handler == op_4XNN) fused = op_4XNN_1NNN;
+        else if (inst->handler == op_5XY0) fused = op_5XY0_1NNN;
+        else if (inst->handler == op_9XY0) fused = op_9XY0_1NNN;
+        else if (inst->handler == op_EX9E) fused = op_EX9E_1NNN;
+        else if (inst->handler == op_EXA1) fused = op_EXA1_1NNN;
+    } else if ((next >> 12) == 0xD && inst->handler == op_6XNN) {
+        fused = op_6XNN_DXYN;
+    }
+
+    if (!fused) return;
+
+    // Fused handlers read the second half straight from the next entry
+    if (chip8->decoded[index + 1].handler == op_decode) decode_entry(chip8, index + 1);
+    inst->fused = fused;
+}
+
+/**
+ * Initial handler of every cache entry; decodes the entry and runs it
+ * @param chip8 Machine instance
+ * @param inst Cache entry being executed
+*/
+void op_decode(chip8_t *chip8, const decoded_t *inst) {
+    const uint32_t index = inst - chip8->decoded;
+    decode_entry(chip8, index);
+    chip8->decoded[index].handler(chip8, &chip8->decoded[index]);
+}
+
+/**
+ * Drop cached decodes overlapping a written memory range
+ * @param chip8 Machine instance
+ * @param addr Start address of the write
+ * @param len Number of bytes written
+*/
+void invalidate_decoded(chip8_t *chip8, uint32_t addr, uint32_t len) {
+    // Remembered for the next reset, which puts the boot image back over it
+    if (addr < chip8->dirty_start) chip8->dirty_start = addr;
+    if (addr + len > chip8->dirty_end) chip8->dirty_end = addr + len;
+
+    // Start one entry early, since a fused pair also covers the next entry
+    uint32_t first = addr / 2;
+    const uint32_t last = (addr + len - 1) / 2;
+    if (first > 0) first--;
+
+    for (uint32_t i = first; i <= last && i < CHIP8_DECODED_SIZE; i++) {
+        chip8->decoded[i] = (decoded_t){ .handler = op_decode };
+    }
+
+    if (chip8->jit) invalidate_jit(chip8, addr, len);
+}
+
+/**
+ * Emulate current instruction
+ * @param chip8 Machine instance
+*/
+void emulate_instruction(chip8_t *chip8) {
+    const uint16_t pc = chip8->PC;
+
+    if (pc & 0xF001) {
+        // Unaligned or out of range, decode on the fly
+        decoded_t inst;
+        decode_instruction((chip8->memory[pc & 0xFFF] << 8) | chip8->memory[(pc + 1) & 0xFFF], &inst);
+        chip8->PC += 2;
+        debug_prefix(&inst, pc);
+        profile_hook(&inst, pc);
+        inst.handler(chip8, &inst);
+        trace_hook(chip8, pc, inst.opcode);
+        return;
+    }
+
+    const decoded_t *inst = &chip8->decoded[pc >> 1];
+#if defined(DEBUG) || defined(PROFILE) || defined(TRACE)
+    // Decode up front so the trace and the profile see the real opcode
+    if (inst->handler == op_decode) decode_entry(chip8, pc >> 1);
+#endif
+    // Kept aside since FX55 may invalidate the entry it runs from
+    const uint16_t opcode = inst->opcode;
+    chip8->PC += 2;
+    debug_prefix(inst, pc);
+    profile_hook(inst, pc);
+    inst->handler(chip8, inst);
+    trace_hook(chip8, pc, opcode);
+}
+
+/**
+ * Check whether a backward jump closed an iteration that changed nothing;
+ * within a frame DT and the keypad are constant, so such a loop repeats
+ * exactly until the frame ends
+ * @param chip8 Machine instance
+ * @param done Instructions run so far in the frame
+ * @param insts Number of instructions per frame
+ * @return Instructions that can be skipped, a whole number of iterations
+*/
+uint32_t skip_idle_loop(chip8_t *chip8, uint32_t done, uint32_t insts) {
+    idle_t *idle = &chip8->idle;
+
+    if (idle->head == chip8->PC && idle->effects == chip8->effects && idle->I == chip8->I &&
+        idle->sp == chip8->sp && memcmp(idle->V, chip8->V, sizeof(idle->V)) == 0) {
+        idle->period = done - idle->done;
+        idle->reads = chip8->reads;
+        idle->DT = chip8->DT;
+        idle->active = true;
+
+        const uint32_t skip = (insts - done) / idle->period * idle->period;
+        idle->done = done + skip;
+        idle->countdown = 1;
+        return skip;
+    }
+
+    // Busy loops are checked less and less often; a state that recurs any
+    // number of iterations later still repeats with that period
+    if (idle->head == chip8->PC && idle->backoff < idle_max_backoff) idle->backoff *= 2;
+    else if (idle->head != chip8->PC) idle->backoff = 1;
+    idle->countdown = idle->backoff;
+
+    // New candidate loop head
+    idle->head = chip8->PC;
+    idle->I = chip8->I;
+    idle->sp = chip8->sp;
+    memcpy(idle->V, chip8->V, sizeof(idle->V));
+    idle->effects = chip8->effects;
+    idle->done = done;
+    idle->active = false;
+    chip8->reads = 0;
+    return 0;
+}
+
+/**
+ * Emulate part of a frame without ticking the timers, so input can change
+ * between parts; idle loop detection starts over with every slice
+ * @param chip8 Machine instance
+ * @param insts Number of instructions in the slice
+*/
+void emulate_slice(chip8_t *chip8, uint32_t insts) {
+    // Timers and keys may have changed since the last snapshot
+    chip8->idle.head = 0xFFFF;
+    chip8->idle.active = false;
+    chip8->idle.countdown = 1;
+    chip8->idle.backoff = 1;
+
+    if (chip8->jit) {
+        run_jit(chip8, insts);
+        return;
+    }
+
+    uint32_t done = 0;
+    uint16_t pc = chip8->PC;
+
+    while (done < insts) {
+        const decoded_t *inst = &chip8->decoded[(pc & 0xFFF) >> 1];
+
+        // Superinstructions only run when the whole pair fits in the slice
+        if (inst->fused && !(pc & 0xF001) && insts - done >= 2) {
+            done += inst->fused(chip8, inst);
+        } else {
+            emulate_instruction(chip8);
+            done++;
+        }
+
+        // Backward control transfers close loops that may be idling; kept off the hot path.
+        // Profiling and tracing run every instruction so idle loops show up as spent cycles
+        const uint16_t next = chip8->PC;
+#if !defined(PROFILE) && !defined(TRACE)
+        if (__builtin_expect(next <= pc && !--chip8->idle.countdown, 0)) {
+            done += skip_idle_loop(chip8, done, insts);
+        }
+#endif
+        pc = next;
+    }
+}
+
+/**
+ * Emulate one frame's worth of instructions
+ * @param chip8 Machine instance
+ * @param insts Number of instructions per frame
+*/
+void emulate_frame(chip8_t *chip8, uint32_t insts) {
+    emulate_slice(chip8, insts);
+    update_timers(chip8);
+}
+
+/**
+ * Instructions to run in a given frame, spreading the remainder of
+ * insts_per_sec / 60 so every second runs exactly insts_per_sec
+ * @param insts_per_sec Instructions per second
+ * @param frame Zero-based frame number
+ * @return Instruction budget for the frame
+*/
+uint32_t frame_budget(uint32_t insts_per_sec, uint64_t frame) {
+    const uint64_t before = frame * insts_per_sec / CHIP8_FRAME_RATE;
+    const uint64_t after = (frame + 1) * insts_per_sec / CHIP8_FRAME_RATE;
+    return (uint32_t)(after - before);
+}
+
+/**
+ * Instructions of a frame that run before one of its slices starts, spreading
+ * the remainder the same way frame_budget does
+ * @param insts Instruction budget of the frame
+ * @param slices Number of slices per frame
+ * @param slice Zero-based slice number, or slices for the end of the frame
+ * @return Instruction offset of the slice within the frame
+*/
+uint32_t slice_offset(uint32_t insts, uint32_t slices, uint32_t slice) {
+    return (uint32_t)((uint64_t)slice * insts / slices);
+}
+
+/**
+ * Whether the machine is idling in a way that only the timers can change
+ * until new input arrives
+ * @param chip8 Machine instance
+ * @return Whether skip_idle_frames can be used
+*/
+bool can_skip_idle(const chip8_t *chip8) {
+    if (!chip8->idle.active) return false;
+
+    // A loop polling DT keeps behaving the same only once DT has settled at zero
+    return !(chip8->idle.reads & CHIP8_READS_DT) || (chip8->idle.DT == 0 && chip8->DT == 0);
+}
+
+/**
+ * Fast-forward an idle machine by whole frames; only the loop position and
+ * the timers move, as if every frame had been emulated with unchanged input
+ * @param chip8 Machine instance
+ * @param frames Number of frames to skip
+ * @param insts Total instruction budget of those frames
+*/
+void skip_idle_frames(chip8_t *chip8, uint64_t frames, uint64_t insts) {
+    // The loop is periodic, so only the last partial iteration needs running
+    for (uint64_t i = 0; i < insts % chip8->idle.period; i++) {
+        emulate_instruction(chip8);
+    }
+
+    chip8->DT = chip8->DT > frames ? chip8->DT - frames : 0;
+    chip8->ST = chip8->ST > frames ? chip8->ST - frames : 0;
+}
+
+/**
+ * Follow one iteration of an idle loop from its head with DT unknown. The
+ * loop may only load DT, load constants, compare and jump, so it takes the
+ * same path for every DT except the values it compares against
+ * @param chip8 Machine instance
+ * @param V Registers at the loop head; updated to those at the end of the iteration
+ * @param loaded Registers holding DT, a bit each; updated the same way
+ * @param compared DT values the path depends on, a bit each
+ * @return Instructions in the iteration, or 0 if the loop does anything else
+*/
+uint32_t walk_dt_wait(const chip8_t *chip8, uint8_t V[16], uint16_t *loaded, uint64_t compared[4]) {
+    uint16_t pc = chip8->idle.head;
+
+    for (uint32_t steps = 1; steps <= chip8->idle.period; steps++) {
+        const uint16_t opcode = (chip8->memory[pc & 0xFFF] << 8) | chip8->memory[(pc + 1) & 0xFFF];
+        const uint8_t x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, nn = opcode & 0xFF;
+        const bool dx = *loaded >> x & 1, dy = *loaded >> y & 1;
+        bool skip = false;
+        pc += 2;
+
+        switch (opcode >> 12) {
+        case 0x1:
+            pc = opcode & 0xFFF;
+            break;
+        case 0x3:
+        case 0x4:
+            // Against DT, the path taken for the current DT stands for every value but nn
+            if (dx) compared[nn >> 6] |= 1ull << (nn & 63);
+            skip = ((dx ? chip8->DT : V[x]) == nn) == ((opcode >> 12) == 0x3);
+            break;
+        case 0x5:
+        case 0x9:
+            // Two registers loaded in different frames may hold different DT values
+            if ((opcode & 0xF) != 0 || (dx && dy)) return 0;
+            if (dx != dy) {
+                const uint8_t value = dx ? V[y] : V[x];
+                compared[value >> 6] |= 1ull << (value & 63);
+            }
+            skip = ((dx ? chip8->DT : V[x]) == (dy ? chip8->DT : V[y])) == ((opcode >> 12) == 0x5);
+            break;
+        case 0x6:
+            V[x] = nn;
+            *loaded &= ~(1u << x);
+            break;
+        case 0xF:
+            if (nn != 0x07) return 0;
+            *loaded |= 1u << x;
+            break;
+        default:
+            return 0;
+        }
+        if (skip) pc += 2;
+
+        if (pc == chip8->idle.head) return steps;
+    }
+    return 0;
+}
+
+/**
+ * Count the frames an idle loop keeps spinning while DT counts down, before
+ * DT reaches a value that may let it out
+ * @param chip8 Machine instance
+ * @return Frames that skip_dt_wait can skip, 0 if the loop is not a plain DT wait
+*/
+uint64_t count_dt_wait(const chip8_t *chip8) {
+    const idle_t *idle = &chip8->idle;
+    if (!idle->active || idle->reads != CHIP8_READS_DT || chip8->DT == 0) return 0;
+
+    // The first walk finds the registers loaded from DT; at the loop head they
+    // already hold it, so the second walk starts from them and has to end the same way
+    uint64_t compared[4] = {0};
+    uint8_t V[16];
+    uint16_t loaded = 0;
+    memcpy(V, idle->V, sizeof(V));
+    if (walk_dt_wait(chip8, V, &loaded, compared) == 0) return 0;
+
+    const uint16_t start = loaded;
+    memcpy(V, idle->V, sizeof(V));
+    memset(compared, 0, sizeof(compared));
+    const uint32_t length = walk_dt_wait(chip8, V, &loaded, compared);
+    if (length == 0 || loaded != start || idle->period % length != 0) return 0;
+
+    // The loop seen in the last frame has to be this one with its DT filled in
+    for (uint8_t i = 0; i < 16; i++) {
+        if (loaded >> i & 1 ? idle->V[i] != idle->DT : V[i] != idle->V[i]) return 0;
+    }
+
+    // Registers loaded in the last frame still hold its DT when the next one starts
+    if (compared[idle->DT >> 6] >> (idle->DT & 63) & 1) return 0;
+
+    uint64_t frames = 0;
+    for (uint8_t dt = chip8->DT; dt > 0 && !(compared[dt >> 6] >> (dt & 63) & 1); dt--) frames++;
+    return frames;
+}
+
+/**
+ * Fast-forward a loop waiting on DT by whole frames, as if every frame had
+ * been emulated; DT ends where the next frame may leave the loop
+ * @param chip8 Machine instance
+ * @param frames Number of frames to skip, at most count_dt_wait
+ * @param insts Total instruction budget of those frames
+*/
+void skip_dt_wait(chip8_t *chip8, uint64_t frames, uint64_t insts) {
+    // One full iteration under the last skipped frame's DT loads it everywhere,
+    // then the partial one lands on the loop position
+    chip8->DT -= frames - 1;
+    for (uint64_t i = 0; i < chip8->idle.period + insts % chip8->idle.period; i++) {
+        emulate_instruction(chip8);
+    }
+
+    chip8->idle.DT = chip8->DT;
+    chip8->DT--;
+    chip8->ST = chip8->ST > frames ? chip8->ST - frames : 0;
+}
+
+/**
+ * Whether only new input can change the machine: it waits on FX0A or spins in
+ * an idle loop, with both timers stopped
+ * @param chip8 Machine instance
+ * @return Whether frames can be held back until input arrives
+*/
+bool is_blocked(const chip8_t *chip8) {
+    return (chip8->key_wait || can_skip_idle(chip8)) && chip8->DT == 0 && chip8->ST == 0;
+}
+
+/**
+ * Run one frame the way the frontends schedule it: a machine blocked on FX0A
+ * or spinning in an idle loop only has its timers advanced until input arrives
+ * @param chip8 Machine instance
+ * @param insts Instruction budget of the frame
+ * @param input Whether input arrived since the previous frame
+ * @return Whether the frame ran, false if nothing can change until input arrives
+*/
+bool step_frame(chip8_t *chip8, uint32_t insts, bool input) {
+    if (!input && (chip8->key_wait || can_skip_idle(chip8))) {
+        if (is_blocked(chip8)) return false;
+
+        if (chip8->key_wait) update_timers(chip8);
+        else skip_idle_frames(chip8, 1, insts);
+        return true;
+    }
+
+    emulate_frame(chip8, insts);
+    return true;
+}
+
+/**
+ * Run one frame that counts whether or not the machine is blocked, as runners
+ * stepping a fixed frame schedule need: a blocked idle loop still spins through
+ * the frame, so input arriving later lands on the same iteration as it would
+ * with every frame emulated
+ * @param chip8 Machine instance
+ * @param insts Instruction budget of the frame
+ * @param input Whether input arrived since the previous frame
+ * @return Whether the frame ran, false if it found the machine waiting for input
+*/
+bool advance_frame(chip8_t *chip8, uint32_t insts, bool input) {
+    if (step_frame(chip8, insts, input)) return true;
+
+    // FX0A holds PC in place, but an idle loop keeps moving through its iterations
+    if (!chip8->key_wait) skip_idle_frames(chip8, 1, insts);
+    return false;
+}
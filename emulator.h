@@ -0,0 +1,129 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+// Each display row is packed into one word, with pixel 0 in the MSB
+#define CHIP8_WIDTH 64
+#define CHIP8_HEIGHT 32
+#define CHIP8_ENTRY_POINT 0x200
+#define CHIP8_FRAME_RATE 60
+#define CHIP8_DECODED_SIZE (4096 / 2)
+
+// Machine state read by an idle loop
+#define CHIP8_READS_DT 1
+#define CHIP8_READS_KEYS 2
+
+// Types
+typedef struct chip8 chip8_t;
+typedef struct decoded decoded_t;
+typedef struct jit jit_t;
+typedef void (*handler_t)(chip8_t *chip8, const decoded_t *inst);
+typedef uint32_t (*fused_handler_t)(chip8_t *chip8, const decoded_t *inst);
+
+struct decoded {
+    handler_t handler;
+    fused_handler_t fused;
+    uint16_t opcode;
+    uint16_t NNN;
+    uint8_t NN;
+    uint8_t N;
+    uint8_t X;
+    uint8_t Y;
+};
+
+// Machine at the head of the last checked backward jump, to spot loops that repeat exactly
+typedef struct {
+    uint16_t head;
+    uint16_t I;
+    uint8_t V[16];
+    uint8_t sp;
+    uint32_t effects;
+    uint32_t done;
+    uint32_t period;   // Instructions per iteration once idle
+    uint8_t reads;     // CHIP8_READS_* flags of the idle loop
+    uint8_t DT;        // DT seen by the idle loop
+    uint8_t countdown; // Backward jumps left before the next check
+    uint8_t backoff;
+    bool active;       // Last frame ended spinning in a loop with no side effects
+} idle_t;
+
+struct chip8 {
+    uint8_t memory[4096];
+    uint16_t stack[16];
+    uint8_t sp;
+    uint8_t V[16];
+    uint16_t PC;
+    uint16_t I;
+    uint8_t DT;
+    uint8_t ST;
+    uint64_t display[CHIP8_HEIGHT];
+    bool keypad[16];
+    bool draw_flag;
+
+    // FX0A wait state; key_wait is set while the last instruction was a blocked FX0A
+    bool key_pressed;
+    bool key_wait;
+    uint8_t key;
+
+    // CXNN random sequence; restarts from seed on every init, so the same seed
+    // and input replay the same run
+    uint64_t seed;
+    uint64_t rng;
+
+    // Font and ROM as loaded, copied over memory on every reset. Memory written
+    // since the last reset lies in [dirty_start, dirty_end)
+    const char *rom;
+    uint8_t boot[4096];
+    uint32_t dirty_start;
+    uint32_t dirty_end;
+
+    // Optional recompiler, NULL when interpreting
+    jit_t *jit;
+
+    // Idle loop detection; effects counts instructions with side effects other than
+    // on V, I and PC, reads collects the CHIP8_READS_* state looked at since a snapshot
+    uint32_t effects;
+    uint8_t reads;
+    idle_t idle;
+
+    // Predecoded instruction for every even address
+    decoded_t decoded[CHIP8_DECODED_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+bool load_rom_buffer(chip8_t *chip8, const uint8_t *rom, size_t rom_size);
+bool load_rom(chip8_t *chip8, const char *rom_name);
+void reset_emulator(chip8_t *chip8);
+bool init_emulator(chip8_t *chip8, const char *rom_name);
+void update_timers(chip8_t *chip8);
+void decode_instruction(uint16_t opcode, decoded_t *inst);
+void invalidate_decoded(chip8_t *chip8, uint32_t addr, uint32_t len);
+void emulate_instruction(chip8_t *chip8);
+void emulate_slice(chip8_t *chip8, uint32_t insts);
+void emulate_frame(chip8_t *chip8, uint32_t insts);
+uint32_t frame_budget(uint32_t insts_per_sec, uint64_t frame);
+uint32_t slice_offset(uint32_t insts, uint32_t slices, uint32_t slice);
+bool can_skip_idle(const chip8_t *chip8);
+void skip_idle_frames(chip8_t *chip8, uint64_t frames, uint64_t insts);
+uint64_t count_dt_wait(const chip8_t *chip8);
+void skip_dt_wait(chip8_t *chip8, uint64_t frames, uint64_t insts);
+bool is_blocked(const chip8_t *chip8);
+bool step_frame(chip8_t *chip8, uint32_t insts, bool input);
+bool advance_frame(chip8_t *chip8, uint32_t insts, bool input);
+
+#endif
@@ -0,0 +1,179 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "fade.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+typedef void (*fade_kernel_t)(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t weight);
+
+// Kernel selected on first use
+fade_kernel_t fade_kernel = NULL;
+const char *fade_name = NULL;
+
+/* -------------------------------------------------------------------------- */
+/*                                   KERNELS                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Fade colors towards their targets one channel at a time
+ * @param colors RGBA colors, updated in place
+ * @param targets RGBA target colors
+ * @param count Number of colors
+ * @param weight Remaining distance per step, in 1/256ths
+*/
+void fade_scalar(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t weight) {
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t s = colors[i];
+        const uint32_t e = targets[i];
+        if (s == e) continue;
+
+        uint32_t result = 0;
+        for (uint32_t shift = 0; shift < 32; shift += 8) {
+            const uint32_t sc = (s >> shift) & 0xFF;
+            const uint32_t ec = (e >> shift) & 0xFF;
+
+            // Shrink the distance, rounding towards the target so fades converge
+            const uint32_t m = ((sc > ec ? sc - ec : ec - sc) * weight) >> 8;
+            result |= (sc > ec ? ec + m : ec - m) << shift;
+        }
+        colors[i] = result;
+    }
+}
+
+#if defined(__x86_64__)
+
+/**
+ * Fade 4 colors at a time with SSE2
+ * @param colors RGBA colors, updated in place
+ * @param targets RGBA target colors
+ * @param count Number of colors
+ * @param weight Remaining distance per step, in 1/256ths
+*/
+void fade_sse2(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t weight) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k = _mm_set1_epi16((int16_t)weight);
+    uint32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(colors + i));
+        const __m128i e = _mm_loadu_si128((const __m128i *)(targets + i));
+
+        // Per-channel distance and direction
+        const __m128i above = _mm_subs_epu8(s, e);
+        const __m128i below = _mm_subs_epu8(e, s);
+        const __m128i d = _mm_or_si128(above, below);
+        const __m128i rising = _mm_cmpeq_epi8(above, zero);
+
+        // Scale the distance in 16-bit lanes
+        const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), k), 8);
+        const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), k), 8);
+        const __m128i m = _mm_packus_epi16(lo, hi);
+
+        const __m128i up = _mm_sub_epi8(e, m);
+        const __m128i down = _mm_add_epi8(e, m);
+        const __m128i result = _mm_or_si128(_mm_and_si128(rising, up), _mm_andnot_si128(rising, down));
+        _mm_storeu_si128((__m128i *)(colors + i), result);
+    }
+
+    fade_scalar(colors + i, targets + i, count - i, weight);
+}
+
+/**
+ * Fade 8 colors at a time with AVX2
+ * @param colors RGBA colors, updated in place
+ * @param targets RGBA target colors
+ * @param count Number of colors
+ * @param weight Remaining distance per step, in 1/256ths
+*/
+__attribute__((target("avx2")))
+void fade_avx2(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t weight) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i k = _mm256_set1_epi16((int16_t)weight);
+    uint32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_loadu_si256((const __m256i *)(colors + i));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(targets + i));
+
+        // Per-channel distance and direction
+        const __m256i above = _mm256_subs_epu8(s, e);
+        const __m256i below = _mm256_subs_epu8(e, s);
+        const __m256i d = _mm256_or_si256(above, below);
+        const __m256i rising = _mm256_cmpeq_epi8(above, zero);
+
+        // Unpack and pack both work within 128-bit lanes, so the order is kept
+        const __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), k), 8);
+        const __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), k), 8);
+        const __m256i m = _mm256_packus_epi16(lo, hi);
+
+        const __m256i up = _mm256_sub_epi8(e, m);
+        const __m256i down = _mm256_add_epi8(e, m);
+        _mm256_storeu_si256((__m256i *)(colors + i), _mm256_blendv_epi8(down, up, rising));
+    }
+
+    fade_sse2(colors + i, targets + i, count - i, weight);
+}
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                    FADE                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Pick the widest kernel supported by the running CPU
+*/
+void select_fade_kernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fade_kernel = fade_avx2;
+        fade_name = "AVX2";
+        return;
+    }
+    fade_kernel = fade_sse2;
+    fade_name = "SSE2";
+#else
+    fade_kernel = fade_scalar;
+    fade_name = "scalar";
+#endif
+}
+
+/**
+ * Move every color a fixed fraction of the way towards its target
+ * @param colors RGBA colors, updated in place
+ * @param targets RGBA target colors
+ * @param count Number of colors
+ * @param rate Fraction of the distance covered per step, between 0 and 1
+*/
+void fade_colors(uint32_t *colors, const uint32_t *targets, uint32_t count, float rate) {
+    if (!fade_kernel) select_fade_kernel();
+
+    // 8-bit fixed point; the remaining distance is rounded down so colors always converge
+    int32_t covered = (int32_t)(rate * 256.0f + 0.5f);
+    if (covered < 0) covered = 0;
+    if (covered > 256) covered = 256;
+
+    fade_kernel(colors, targets, count, 256 - covered);
+}
+
+/**
+ * Name of the kernel used by fade_colors
+ * @return Kernel name
+*/
+const char *fade_kernel_name() {
+    if (!fade_kernel) select_fade_kernel();
+    return fade_name;
+}
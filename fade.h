@@ -0,0 +1,17 @@
+#ifndef FADE_H
+#define FADE_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+void fade_colors(uint32_t *colors, const uint32_t *targets, uint32_t count, float rate);
+const char *fade_kernel_name(void);
+
+#endif
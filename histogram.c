@@ -0,0 +1,91 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdio.h>
+
+#include "histogram.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+const double histogram_base = 0.25; // Upper bound of the first bucket, in milliseconds
+const uint32_t histogram_bar = 40;  // Width of the fullest bucket when printed
+
+/* -------------------------------------------------------------------------- */
+/*                                  HISTOGRAM                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Upper bound of a bucket
+ * @param bucket Bucket index
+ * @return Bound in milliseconds
+*/
+double bucket_bound(uint32_t bucket) {
+    return histogram_base * (double)(1U << bucket);
+}
+
+/**
+ * Count a duration
+ * @param histogram Histogram
+ * @param ms Duration in milliseconds
+*/
+void add_histogram_sample(histogram_t *histogram, double ms) {
+    uint32_t bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && ms >= bucket_bound(bucket)) bucket++;
+
+    histogram->counts[bucket]++;
+    histogram->samples++;
+    histogram->sum += ms;
+    if (ms > histogram->max) histogram->max = ms;
+}
+
+/**
+ * Bound below which a given fraction of the samples fall, rounded up to a bucket
+ * @param histogram Histogram
+ * @param fraction Fraction of the samples, between 0 and 1
+ * @return Bucket bound in milliseconds, the maximum for the last bucket, 0 if empty
+*/
+double get_histogram_percentile(const histogram_t *histogram, double fraction) {
+    const double wanted = fraction * histogram->samples;
+    uint64_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen > 0 && seen >= wanted) return bucket_bound(bucket);
+    }
+    return histogram->max;
+}
+
+/**
+ * Print a summary line and one bar per bucket from the first to the last non-empty one
+ * @param histogram Histogram
+ * @param name What was measured
+*/
+void print_histogram(const histogram_t *histogram, const char *name) {
+    if (histogram->samples == 0) return;
+
+    printf("[INFO] %s: %llu samples, %.2f ms mean, p50 < %.2f ms, p99 < %.2f ms, %.2f ms max\n", name,
+        (unsigned long long)histogram->samples, histogram->sum / histogram->samples,
+        get_histogram_percentile(histogram, 0.5), get_histogram_percentile(histogram, 0.99), histogram->max);
+
+    uint32_t first = 0, last = HISTOGRAM_BUCKETS - 1;
+    uint64_t fullest = 0;
+    while (histogram->counts[first] == 0) first++;
+    while (histogram->counts[last] == 0) last--;
+    for (uint32_t bucket = first; bucket <= last; bucket++) {
+        if (histogram->counts[bucket] > fullest) fullest = histogram->counts[bucket];
+    }
+
+    for (uint32_t bucket = first; bucket <= last; bucket++) {
+        char bar[64] = {0};
+        const uint32_t width = (uint32_t)((histogram->counts[bucket] * histogram_bar + fullest - 1) / fullest);
+        for (uint32_t i = 0; i < width; i++) bar[i] = '#';
+
+        if (bucket < HISTOGRAM_BUCKETS - 1) printf("[INFO]   < %7.2f ms ", bucket_bound(bucket));
+        else printf("[INFO]  >= %7.2f ms ", bucket_bound(bucket - 1));
+        printf("%-*s %llu\n", (int)histogram_bar, bar, (unsigned long long)histogram->counts[bucket]);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define HISTOGRAM_BUCKETS 12
+
+// Types
+// Durations in milliseconds; bucket b holds samples below 2^b / 4 ms, the last one the rest.
+// Zero-initialized histograms are empty
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t samples;
+    double sum;
+    double max;
+} histogram_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+void add_histogram_sample(histogram_t *histogram, double ms);
+double get_histogram_percentile(const histogram_t *histogram, double fraction);
+void print_histogram(const histogram_t *histogram, const char *name);
+
+#endif
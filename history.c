@@ -0,0 +1,295 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+#include "snapshot.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define HISTORY_WORDS (sizeof(snapshot_t) / sizeof(uint64_t))
+const uint64_t history_keyframe_interval = 60;
+const size_t history_frame_bytes = 256; // Average frame size the entry ring is sized for
+
+// Types
+// Arena placement of one frame; a keyframe holds a whole snapshot, any other
+// frame the run-length encoded XOR between its snapshot and its keyframe's
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+    uint64_t keyframe; // Frame number of the keyframe
+} entry_t;
+
+/*
+ * Frames live in a byte arena used as a ring: each one goes right after the
+ * previous one, wrapping to the start when it does not fit, and the oldest
+ * frames are dropped to make room. The oldest frame held is always a keyframe.
+*/
+struct history {
+    uint8_t *arena;
+    size_t arena_size;
+    size_t write;
+    size_t used;
+
+    entry_t *entries; // Indexed by frame number modulo capacity
+    uint64_t capacity;
+    uint64_t first;   // Oldest frame held
+    uint64_t next;    // Frame number of the next push
+    uint64_t keyframe;
+    uint64_t keyframes;
+
+    snapshot_t base;  // Snapshot of the newest keyframe
+    snapshot_t current;
+    uint8_t encoded[2 * sizeof(snapshot_t)];
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                   ENCODING                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Read an unaligned 64-bit word
+ * @param bytes Start of the words
+ * @param index Word index
+ * @return Word
+*/
+uint64_t load_word(const void *bytes, size_t index) {
+    uint64_t word;
+    memcpy(&word, (const uint8_t *)bytes + index * sizeof(word), sizeof(word));
+    return word;
+}
+
+/**
+ * Encode the XOR of two snapshots as runs of (unchanged words, changed words)
+ * counts followed by the changed words
+ * @param base Keyframe snapshot
+ * @param current Snapshot to encode
+ * @param out Output, at least 2 * sizeof(snapshot_t) bytes
+ * @return Encoded size in bytes
+*/
+size_t encode_delta(const snapshot_t *base, const snapshot_t *current, uint8_t *out) {
+    size_t size = 0;
+    size_t i = 0;
+
+    while (i < HISTORY_WORDS) {
+        const size_t skip_start = i;
+        while (i < HISTORY_WORDS && load_word(base, i) == load_word(current, i)) i++;
+        if (i == HISTORY_WORDS) break;
+
+        const size_t start = i;
+        while (i < HISTORY_WORDS && load_word(base, i) != load_word(current, i)) i++;
+
+        const uint16_t run[2] = { start - skip_start, i - start };
+        memcpy(out + size, run, sizeof(run));
+        size += sizeof(run);
+
+        for (size_t j = start; j < i; j++) {
+            const uint64_t delta = load_word(base, j) ^ load_word(current, j);
+            memcpy(out + size, &delta, sizeof(delta));
+            size += sizeof(delta);
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Apply an encoded delta on top of its keyframe snapshot
+ * @param snapshot Keyframe snapshot, updated in place
+ * @param data Encoded delta
+ * @param size Encoded size in bytes
+*/
+void apply_delta(snapshot_t *snapshot, const uint8_t *data, size_t size) {
+    uint8_t *bytes = (uint8_t *)snapshot;
+    size_t i = 0;
+
+    for (size_t pos = 0; pos < size; ) {
+        uint16_t run[2];
+        memcpy(run, data + pos, sizeof(run));
+        pos += sizeof(run);
+        i += run[0];
+
+        for (uint16_t j = 0; j < run[1]; j++, i++, pos += sizeof(uint64_t)) {
+            const uint64_t word = load_word(bytes, i) ^ load_word(data + pos, 0);
+            memcpy(bytes + i * sizeof(word), &word, sizeof(word));
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   HISTORY                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Create a rewind history within a fixed memory budget
+ * @param bytes Total memory for frames and their bookkeeping
+ * @return History, NULL if the budget is too small or allocation failed
+*/
+history_t *create_history(size_t bytes) {
+    const uint64_t capacity = bytes / (history_frame_bytes + sizeof(entry_t));
+    const size_t arena_size = bytes - capacity * sizeof(entry_t);
+    if (capacity < 2 * history_keyframe_interval || arena_size > UINT32_MAX) return NULL;
+
+    history_t *history = calloc(1, sizeof(history_t));
+    if (!history) return NULL;
+
+    history->arena = malloc(arena_size);
+    history->entries = malloc(capacity * sizeof(entry_t));
+    if (!history->arena || !history->entries) {
+        destroy_history(history);
+        return NULL;
+    }
+
+    history->arena_size = arena_size;
+    history->capacity = capacity;
+    return history;
+}
+
+/**
+ * Free a rewind history
+ * @param history History
+*/
+void destroy_history(history_t *history) {
+    if (!history) return;
+
+    free(history->arena);
+    free(history->entries);
+    free(history);
+}
+
+/**
+ * Drop the oldest frame, along with the frames that depended on it as their keyframe
+ * @param history History
+*/
+void drop_oldest(history_t *history) {
+    do {
+        const entry_t *entry = &history->entries[history->first % history->capacity];
+        if (entry->keyframe == history->first) history->keyframes--;
+        history->used -= entry->size;
+        history->first++;
+    } while (history->first < history->next &&
+        history->entries[history->first % history->capacity].keyframe != history->first);
+}
+
+/**
+ * Find room for a new frame, dropping the oldest frames in the way
+ * @param history History
+ * @param size Frame size in bytes
+ * @return Arena offset for the frame
+*/
+size_t reserve_frame(history_t *history, size_t size) {
+    size_t offset = history->write;
+
+    if (offset + size > history->arena_size) {
+        // Frames still past the write position are the oldest; start over from the beginning
+        while (history->first < history->next &&
+            history->entries[history->first % history->capacity].offset >= offset) {
+            drop_oldest(history);
+        }
+        offset = 0;
+    }
+
+    // The oldest frame is always the next one in the way
+    while (history->first < history->next) {
+        const entry_t *oldest = &history->entries[history->first % history->capacity];
+        const bool overlaps = oldest->offset < offset + size && offset < oldest->offset + oldest->size;
+        if (!overlaps && history->next - history->first < history->capacity) break;
+        drop_oldest(history);
+    }
+
+    return offset;
+}
+
+/**
+ * Record the machine state at the end of a frame
+ * @param history History
+ * @param chip8 Machine instance
+*/
+void push_history(history_t *history, const chip8_t *chip8) {
+    save_snapshot(chip8, &history->current);
+
+    const uint8_t *data = history->encoded;
+    size_t size = 0;
+    size_t offset = 0;
+    bool keyframe = history->first == history->next || history->next - history->keyframe >= history_keyframe_interval;
+
+    if (!keyframe) {
+        size = encode_delta(&history->base, &history->current, history->encoded);
+        keyframe = size >= sizeof(snapshot_t);
+    }
+    if (!keyframe) {
+        offset = reserve_frame(history, size);
+
+        // Making room may have dropped the keyframe this delta is against
+        keyframe = history->first > history->keyframe || history->first == history->next;
+    }
+    if (keyframe) {
+        data = (const uint8_t *)&history->current;
+        size = sizeof(snapshot_t);
+        offset = reserve_frame(history, size);
+        history->keyframe = history->next;
+        history->keyframes++;
+        history->base = history->current;
+    }
+
+    memcpy(history->arena + offset, data, size);
+    history->entries[history->next % history->capacity] = (entry_t){
+        .offset = offset,
+        .size = size,
+        .keyframe = history->keyframe,
+    };
+    history->write = offset + size;
+    history->used += size;
+    history->next++;
+}
+
+/**
+ * Step back one frame, restoring the machine to the newest recorded state
+ * and forgetting it
+ * @param history History
+ * @param chip8 Machine instance
+ * @return Whether there was a frame to go back to
+*/
+bool pop_history(history_t *history, chip8_t *chip8) {
+    if (history->first == history->next) return false;
+
+    const uint64_t frame = history->next - 1;
+    const entry_t *entry = &history->entries[frame % history->capacity];
+    const entry_t *key = &history->entries[entry->keyframe % history->capacity];
+
+    memcpy(&history->current, history->arena + key->offset, sizeof(snapshot_t));
+    if (entry->keyframe != frame) apply_delta(&history->current, history->arena + entry->offset, entry->size);
+    restore_snapshot(chip8, &history->current);
+
+    if (entry->keyframe == frame) history->keyframes--;
+    history->used -= entry->size;
+    history->write = entry->offset;
+    history->next = frame;
+
+    // Later frames are encoded against the keyframe of the new newest frame
+    if (history->first < history->next) {
+        history->keyframe = history->entries[(frame - 1) % history->capacity].keyframe;
+        memcpy(&history->base, history->arena + history->entries[history->keyframe % history->capacity].offset, sizeof(snapshot_t));
+    }
+    return true;
+}
+
+/**
+ * Get history usage
+ * @param history History
+ * @param stats Output stats
+*/
+void get_history_stats(const history_t *history, history_stats_t *stats) {
+    stats->frames = history->next - history->first;
+    stats->keyframes = history->keyframes;
+    stats->used = history->used;
+    stats->size = history->arena_size;
+}
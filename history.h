@@ -0,0 +1,38 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+typedef struct history history_t;
+
+typedef struct {
+    uint64_t frames;     // Frames that can be rewound
+    uint64_t keyframes;
+    size_t used;         // Arena bytes held by those frames
+    size_t size;         // Arena size
+} history_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+history_t *create_history(size_t bytes);
+void destroy_history(history_t *history);
+void push_history(history_t *history, const chip8_t *chip8);
+bool pop_history(history_t *history, chip8_t *chip8);
+void get_history_stats(const history_t *history, history_stats_t *stats);
+
+#endif
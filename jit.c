@@ -0,0 +1,631 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+const size_t jit_code_size = 256 * 1024;
+const size_t jit_max_block_size = 4096; // 64 of the longest instructions, each with its budget exit
+const uint32_t jit_max_block_insts = 64;
+const uint32_t jit_page_shift = 8;
+
+// Types
+typedef uint32_t (*block_fn_t)(chip8_t *chip8, uint32_t insts);
+
+typedef struct {
+    block_fn_t fn;
+    uint16_t end;
+    uint8_t insts;
+    bool translated;
+} block_t;
+
+struct jit {
+    uint8_t *code;
+    size_t code_used;
+    block_t blocks[CHIP8_DECODED_SIZE];
+    uint16_t code_pages;
+    bool writable;
+
+    // Differential testing
+    bool diff;
+    bool diverged;
+    chip8_t *shadow;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                   EMITTER                                  */
+/* -------------------------------------------------------------------------- */
+
+#if defined(__x86_64__)
+
+// Code is emitted for the System V ABI: the machine pointer arrives in rdi
+// and the instruction budget in esi, eax returns the instructions run, al
+// and cl are scratch, and every guest register is addressed as [rdi + disp32]
+
+/**
+ * Append a byte to the block being emitted
+ * @param buf Code pointer, advanced past the byte
+ * @param byte Byte to emit
+*/
+void emit_u8(uint8_t **buf, uint8_t byte) {
+    *(*buf)++ = byte;
+}
+
+/**
+ * Append a little-endian 16-bit immediate
+ * @param buf Code pointer
+ * @param value Immediate
+*/
+void emit_u16(uint8_t **buf, uint16_t value) {
+    emit_u8(buf, value & 0xFF);
+    emit_u8(buf, value >> 8);
+}
+
+/**
+ * Append an opcode with a [rdi + disp32] memory operand
+ * @param buf Code pointer
+ * @param op Opcode byte
+ * @param reg ModRM reg field (register or opcode extension)
+ * @param disp Offset into chip8_t
+*/
+void emit_mem(uint8_t **buf, uint8_t op, uint8_t reg, uint32_t disp) {
+    emit_u8(buf, op);
+    emit_u8(buf, 0x80 | (reg << 3) | 7);
+    emit_u8(buf, disp & 0xFF);
+    emit_u8(buf, (disp >> 8) & 0xFF);
+    emit_u8(buf, (disp >> 16) & 0xFF);
+    emit_u8(buf, disp >> 24);
+}
+
+/**
+ * Offset of guest register VX inside chip8_t
+ * @param x Register index
+ * @return Byte offset
+*/
+uint32_t v_offset(uint8_t x) {
+    return offsetof(chip8_t, V) + x;
+}
+
+/**
+ * Emit mov al, [VX]
+ * @param buf Code pointer
+ * @param x Register index
+*/
+void emit_load_al(uint8_t **buf, uint8_t x) {
+    emit_mem(buf, 0x8A, 0, v_offset(x));
+}
+
+/**
+ * Emit mov [VX], al
+ * @param buf Code pointer
+ * @param x Register index
+*/
+void emit_store_al(uint8_t **buf, uint8_t x) {
+    emit_mem(buf, 0x88, 0, v_offset(x));
+}
+
+/**
+ * Emit mov word [PC], imm16
+ * @param buf Code pointer
+ * @param pc New PC
+*/
+void emit_set_pc(uint8_t **buf, uint16_t pc) {
+    emit_u8(buf, 0x66);
+    emit_mem(buf, 0xC7, 0, offsetof(chip8_t, PC));
+    emit_u16(buf, pc);
+}
+
+/**
+ * Emit mov eax, insts; ret
+ * @param buf Code pointer
+ * @param insts Instructions the block ran
+*/
+void emit_return(uint8_t **buf, uint32_t insts) {
+    emit_u8(buf, 0xB8);
+    emit_u16(buf, insts & 0xFFFF);
+    emit_u16(buf, insts >> 16);
+    emit_u8(buf, 0xC3);
+}
+
+/**
+ * Emit an exit taken when the budget runs out before an instruction
+ * @param buf Code pointer
+ * @param insts Instructions run before this one, below 128
+ * @param pc Address of the instruction
+*/
+void emit_budget_exit(uint8_t **buf, uint32_t insts, uint16_t pc) {
+    // cmp esi, insts; jne over the exit
+    emit_u8(buf, 0x83);
+    emit_u8(buf, 0xFE);
+    emit_u8(buf, insts);
+    emit_u8(buf, 0x75);
+    emit_u8(buf, 15);
+
+    emit_set_pc(buf, pc);
+    emit_return(buf, insts);
+}
+
+/**
+ * Emit a flag-producing ALU operation that mirrors the interpreter's order:
+ * VF is written from the original operands before VX is recomputed
+ * @param buf Code pointer
+ * @param inst Decoded instruction
+ * @param a First operand register
+ * @param b Second operand register
+ * @param op ALU opcode taking al, [rdi + disp32] (add/sub/cmp)
+ * @param setcc Second byte of the setcc instruction producing the flag
+*/
+void emit_flag_op(uint8_t **buf, const decoded_t *inst, uint8_t a, uint8_t b, uint8_t op, uint8_t setcc) {
+    // Flag
+    emit_load_al(buf, a);
+    emit_mem(buf, op == 0x2A ? 0x3A : op, 0, v_offset(b));
+    emit_u8(buf, 0x0F);
+    emit_u8(buf, setcc);
+    emit_u8(buf, 0xC1);
+    emit_mem(buf, 0x88, 1, v_offset(0xF));
+
+    // Result
+    emit_load_al(buf, a);
+    emit_mem(buf, op, 0, v_offset(b));
+    emit_store_al(buf, inst->X);
+}
+
+/**
+ * Emit native code for a straight-line instruction
+ * @param buf Code pointer
+ * @param inst Decoded instruction
+ * @return Whether the instruction could be translated
+*/
+bool emit_instruction(uint8_t **buf, const decoded_t *inst) {
+    const uint8_t X = inst->X;
+    const uint8_t Y = inst->Y;
+
+    switch (inst->opcode >> 12) {
+        case 0x6:
+            // mov byte [VX], NN
+            emit_mem(buf, 0xC6, 0, v_offset(X));
+            emit_u8(buf, inst->NN);
+            return true;
+
+        case 0x7:
+            // add byte [VX], NN
+            emit_mem(buf, 0x80, 0, v_offset(X));
+            emit_u8(buf, inst->NN);
+            return true;
+
+        case 0x8:
+            switch (inst->N) {
+                case 0x0:
+                    emit_load_al(buf, Y);
+                    emit_store_al(buf, X);
+                    return true;
+
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    // or/and/xor [VX], al
+                    emit_load_al(buf, Y);
+                    emit_mem(buf, inst->N == 0x1 ? 0x08 : inst->N == 0x2 ? 0x20 : 0x30, 0, v_offset(X));
+                    return true;
+
+                case 0x4:
+                    // VF = carry (setc), VX += VY
+                    emit_flag_op(buf, inst, X, Y, 0x02, 0x92);
+                    return true;
+
+                case 0x5:
+                    // VF = VX > VY (seta), VX -= VY
+                    emit_flag_op(buf, inst, X, Y, 0x2A, 0x97);
+                    return true;
+
+                case 0x6:
+                    // VF = VX & 0xF, shr byte [VX], 1
+                    emit_load_al(buf, X);
+                    emit_u8(buf, 0x24);
+                    emit_u8(buf, 0x0F);
+                    emit_store_al(buf, 0xF);
+                    emit_mem(buf, 0xD0, 5, v_offset(X));
+                    return true;
+
+                case 0x7:
+                    // VF = VY > VX (seta), VX = VY - VX
+                    emit_flag_op(buf, inst, Y, X, 0x2A, 0x97);
+                    return true;
+
+                case 0xE:
+                    // VF = VX >> 7, shl byte [VX], 1
+                    emit_load_al(buf, X);
+                    emit_u8(buf, 0xC0);
+                    emit_u8(buf, 0xE8);
+                    emit_u8(buf, 0x07);
+                    emit_store_al(buf, 0xF);
+                    emit_mem(buf, 0xD0, 4, v_offset(X));
+                    return true;
+
+                default:
+                    return false;
+            }
+
+        case 0xA:
+            // mov word [I], NNN
+            emit_u8(buf, 0x66);
+            emit_mem(buf, 0xC7, 0, offsetof(chip8_t, I));
+            emit_u16(buf, inst->NNN);
+            return true;
+
+        case 0xF:
+            switch (inst->NN) {
+                case 0x07:
+                    emit_mem(buf, 0x8A, 0, offsetof(chip8_t, DT));
+                    emit_store_al(buf, X);
+                    return true;
+
+                case 0x15:
+                    emit_load_al(buf, X);
+                    emit_mem(buf, 0x88, 0, offsetof(chip8_t, DT));
+                    return true;
+
+                case 0x18:
+                    emit_load_al(buf, X);
+                    emit_mem(buf, 0x88, 0, offsetof(chip8_t, ST));
+                    return true;
+
+                case 0x1E:
+                    // movzx eax, byte [VX]; add word [I], ax
+                    emit_u8(buf, 0x0F);
+                    emit_mem(buf, 0xB6, 0, v_offset(X));
+                    emit_u8(buf, 0x66);
+                    emit_mem(buf, 0x01, 0, offsetof(chip8_t, I));
+                    return true;
+
+                case 0x29:
+                    // movzx eax, byte [VX]; lea eax, [rax + rax * 4]; mov word [I], ax
+                    emit_u8(buf, 0x0F);
+                    emit_mem(buf, 0xB6, 0, v_offset(X));
+                    emit_u8(buf, 0x8D);
+                    emit_u8(buf, 0x04);
+                    emit_u8(buf, 0x80);
+                    emit_u8(buf, 0x66);
+                    emit_mem(buf, 0x89, 0, offsetof(chip8_t, I));
+                    return true;
+
+                default:
+                    return false;
+            }
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Emit native code for a block-ending jump or register skip
+ * @param buf Code pointer
+ * @param inst Decoded instruction
+ * @param next Address of the following instruction
+ * @return Whether the instruction could be translated
+*/
+bool emit_terminator(uint8_t **buf, const decoded_t *inst, uint16_t next) {
+    uint8_t jcc;
+
+    switch (inst->opcode >> 12) {
+        case 0x1:
+            emit_set_pc(buf, inst->NNN);
+            return true;
+
+        case 0x3:
+        case 0x4:
+            // cmp byte [VX], NN
+            emit_mem(buf, 0x80, 7, v_offset(inst->X));
+            emit_u8(buf, inst->NN);
+            jcc = (inst->opcode >> 12) == 0x3 ? 0x75 : 0x74;
+            break;
+
+        case 0x5:
+        case 0x9:
+            // mov al, [VX]; cmp al, [VY]
+            emit_load_al(buf, inst->X);
+            emit_mem(buf, 0x3A, 0, v_offset(inst->Y));
+            jcc = (inst->opcode >> 12) == 0x5 ? 0x75 : 0x74;
+            break;
+
+        default:
+            return false;
+    }
+
+    // PC = next; jcc over the skip; PC = next + 2
+    emit_set_pc(buf, next);
+    emit_u8(buf, jcc);
+    emit_u8(buf, 9);
+    emit_set_pc(buf, next + 2);
+    return true;
+}
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                 TRANSLATOR                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Switch the code cache between writable and executable, never both at once;
+ * it stays writable across translations until a block is about to run
+ * @param jit JIT instance
+ * @param writable Whether blocks are about to be emitted
+ * @return Whether the cache has the requested protection
+*/
+bool protect_jit(jit_t *jit, bool writable) {
+    if (jit->writable == writable) return true;
+
+    if (mprotect(jit->code, jit_code_size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+        fprintf(stderr, "[ERROR] Unable to make JIT code %s\n", writable ? "writable" : "executable");
+        return false;
+    }
+    jit->writable = writable;
+    return true;
+}
+
+/**
+ * Translate the basic block starting at an even address
+ * @param chip8 Machine instance
+ * @param pc Block start address
+*/
+void translate_block(chip8_t *chip8, uint16_t pc) {
+    jit_t *jit = chip8->jit;
+    block_t *block = &jit->blocks[pc >> 1];
+    *block = (block_t){ .translated = true };
+
+#if defined(__x86_64__)
+    // Flush everything once the code buffer can't fit another block
+    if (jit->code_used + jit_max_block_size > jit_code_size) flush_jit(chip8);
+    block = &jit->blocks[pc >> 1];
+    block->translated = true;
+
+    uint8_t *start = jit->code + jit->code_used;
+    uint8_t *buf = start;
+    uint16_t addr = pc;
+    uint32_t insts = 0;
+
+    bool exits = false;
+
+    if (!protect_jit(jit, true)) return;
+
+    while (insts < jit_max_block_insts && addr < sizeof(chip8->memory) - 1) {
+        decoded_t inst;
+        decode_instruction((chip8->memory[addr] << 8) | chip8->memory[addr + 1], &inst);
+
+        // A budget ending mid-block stops right before this instruction
+        uint8_t *mark = buf;
+        if (insts > 0) emit_budget_exit(&buf, insts, addr);
+
+        if (emit_instruction(&buf, &inst)) {
+            addr += 2;
+            insts++;
+            continue;
+        }
+
+        // Jumps and register skips are translated as the block's exit
+        if (emit_terminator(&buf, &inst, addr + 2)) {
+            addr += 2;
+            insts++;
+            exits = true;
+        } else {
+            // The block falls through to this instruction anyway
+            buf = mark;
+        }
+        break;
+    }
+
+    if (insts == 0) return;
+
+    // Otherwise fall through to the first untranslatable instruction
+    if (!exits) emit_set_pc(&buf, addr);
+    emit_return(&buf, insts);
+
+    memcpy(&block->fn, &start, sizeof(block->fn));
+    block->end = addr;
+    block->insts = insts;
+    jit->code_used += buf - start;
+
+    // Remember which pages hold translated code
+    for (uint32_t page = pc >> jit_page_shift; page <= (uint32_t)(addr - 1) >> jit_page_shift; page++) {
+        jit->code_pages |= 1 << page;
+    }
+#else
+    (void)chip8;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                     JIT                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Attach a JIT to a machine
+ * @param chip8 Machine instance
+ * @param diff Whether to check every block against the interpreter
+ * @return Whether creation was successful
+*/
+bool create_jit(chip8_t *chip8, bool diff) {
+#if defined(__x86_64__)
+    jit_t *jit = calloc(1, sizeof(jit_t));
+    if (!jit) {
+        fprintf(stderr, "[ERROR] Unable to allocate JIT\n");
+        return false;
+    }
+
+    // Never writable and executable at once, see protect_jit
+    jit->code = mmap(NULL, jit_code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) {
+        fprintf(stderr, "[ERROR] Unable to map memory for JIT\n");
+        free(jit);
+        return false;
+    }
+
+    jit->writable = true;
+
+    if (diff) {
+        jit->diff = true;
+        jit->shadow = malloc(sizeof(chip8_t));
+        if (!jit->shadow) {
+            fprintf(stderr, "[ERROR] Unable to allocate JIT shadow machine\n");
+            munmap(jit->code, jit_code_size);
+            free(jit);
+            return false;
+        }
+    }
+
+    chip8->jit = jit;
+    return true;
+#else
+    (void)chip8;
+    (void)diff;
+    fprintf(stderr, "[ERROR] JIT is only available on x86-64\n");
+    return false;
+#endif
+}
+
+/**
+ * Detach and free a machine's JIT
+ * @param chip8 Machine instance
+*/
+void destroy_jit(chip8_t *chip8) {
+    jit_t *jit = chip8->jit;
+    if (!jit) return;
+
+    munmap(jit->code, jit_code_size);
+    free(jit->shadow);
+    free(jit);
+    chip8->jit = NULL;
+}
+
+/**
+ * Drop every translated block
+ * @param chip8 Machine instance
+*/
+void flush_jit(chip8_t *chip8) {
+    jit_t *jit = chip8->jit;
+
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    jit->code_used = 0;
+    jit->code_pages = 0;
+}
+
+/**
+ * Flush translations if a memory write hits a page holding translated code
+ * @param chip8 Machine instance
+ * @param addr Start address of the write
+ * @param len Number of bytes written
+*/
+void invalidate_jit(chip8_t *chip8, uint32_t addr, uint32_t len) {
+    jit_t *jit = chip8->jit;
+
+    for (uint32_t page = addr >> jit_page_shift; page <= (addr + len - 1) >> jit_page_shift && page < 16; page++) {
+        if (jit->code_pages & (1 << page)) {
+            flush_jit(chip8);
+            return;
+        }
+    }
+}
+
+/**
+ * Compare a machine against its interpreted shadow and report differences
+ * @param chip8 Machine run through the JIT
+ * @param shadow Machine run through the interpreter
+ * @param pc Start address of the block
+ * @return Whether both machines are in the same state
+*/
+bool compare_shadow(const chip8_t *chip8, const chip8_t *shadow, uint16_t pc) {
+    const char *field = NULL;
+
+    if (memcmp(chip8->V, shadow->V, sizeof(chip8->V)) != 0) field = "V";
+    else if (chip8->I != shadow->I) field = "I";
+    else if (chip8->PC != shadow->PC) field = "PC";
+    else if (chip8->DT != shadow->DT || chip8->ST != shadow->ST) field = "timers";
+    else if (chip8->sp != shadow->sp || memcmp(chip8->stack, shadow->stack, sizeof(chip8->stack)) != 0) field = "stack";
+    else if (memcmp(chip8->memory, shadow->memory, sizeof(chip8->memory)) != 0) field = "memory";
+    else if (memcmp(chip8->display, shadow->display, sizeof(chip8->display)) != 0) field = "display";
+
+    if (!field) return true;
+
+    fprintf(stderr, "[ERROR] JIT diverged from interpreter in %s after block at PC=0x%04X\n", field, pc);
+    for (int i = 0; i < 16; i++) {
+        if (chip8->V[i] != shadow->V[i]) {
+            fprintf(stderr, "[ERROR]   V%01X: jit=0x%02X interpreter=0x%02X\n", i, chip8->V[i], shadow->V[i]);
+        }
+    }
+    fprintf(stderr, "[ERROR]   I: jit=0x%04X interpreter=0x%04X\n", chip8->I, shadow->I);
+    fprintf(stderr, "[ERROR]   PC: jit=0x%04X interpreter=0x%04X\n", chip8->PC, shadow->PC);
+    return false;
+}
+
+/**
+ * Run instructions through translated blocks, interpreting whatever
+ * can't be translated
+ * @param chip8 Machine instance
+ * @param insts Number of instructions to run
+*/
+void run_jit(chip8_t *chip8, uint32_t insts) {
+    jit_t *jit = chip8->jit;
+    uint32_t done = 0;
+
+    while (done < insts) {
+        const uint16_t pc = chip8->PC;
+        if (pc & 0xF001 || jit->diverged) {
+            emulate_instruction(chip8);
+            done++;
+            continue;
+        }
+
+        block_t *block = &jit->blocks[pc >> 1];
+        if (!block->translated) translate_block(chip8, pc);
+
+        if (block->insts == 0 || !protect_jit(jit, false)) {
+            emulate_instruction(chip8);
+            done++;
+            continue;
+        }
+
+        // Blocks stop early where the remaining budget runs out
+        const uint32_t budget = insts - done;
+        if (jit->diff) {
+            // Run the same instructions through the interpreter on a copy
+            memcpy(jit->shadow, chip8, sizeof(chip8_t));
+            jit->shadow->jit = NULL;
+            for (uint32_t i = 0; i < block->insts && i < budget; i++) {
+                emulate_instruction(jit->shadow);
+            }
+        }
+
+        done += block->fn(chip8, budget);
+
+        if (jit->diff && !compare_shadow(chip8, jit->shadow, pc)) {
+            // Keep going on the interpreter from the interpreter's state
+            memcpy(chip8, jit->shadow, sizeof(chip8_t));
+            chip8->jit = jit;
+            jit->diverged = true;
+        }
+    }
+}
+
+/**
+ * Check whether differential testing found a mismatch
+ * @param chip8 Machine instance
+ * @return Whether the JIT diverged from the interpreter
+*/
+bool jit_diverged(const chip8_t *chip8) {
+    return chip8->jit && chip8->jit->diverged;
+}
@@ -0,0 +1,24 @@
+#ifndef JIT_H
+#define JIT_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+bool create_jit(chip8_t *chip8, bool diff);
+void destroy_jit(chip8_t *chip8);
+void flush_jit(chip8_t *chip8);
+void invalidate_jit(chip8_t *chip8, uint32_t addr, uint32_t len);
+void run_jit(chip8_t *chip8, uint32_t insts);
+bool jit_diverged(const chip8_t *chip8);
+
+#endif
@@ -0,0 +1,131 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdlib.h>
+
+#include "emulator.h"
+#include "libchip8.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+// Everything behind the handle may change between builds; callers only see the functions
+struct chip8_instance {
+    chip8_t machine;
+    uint32_t insts_per_sec;
+    uint64_t frame;  // Frames since the last reset, for frame_budget
+    bool loaded;
+    bool input;      // Keys changed since the last frame
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                  INSTANCES                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get the ABI version the library was built with, to check against LIBCHIP8_ABI_VERSION
+ * @return ABI version
+*/
+uint32_t get_chip8_abi_version(void) {
+    return LIBCHIP8_ABI_VERSION;
+}
+
+/**
+ * Create an interpreting machine with no ROM loaded
+ * @param insts_per_sec Instructions per second
+ * @param seed Seed of the CXNN random sequence
+ * @return Instance, NULL if the speed is 0 or allocation failed
+*/
+chip8_instance_t *create_chip8(uint32_t insts_per_sec, uint64_t seed) {
+    if (insts_per_sec == 0) return NULL;
+
+    chip8_instance_t *instance = calloc(1, sizeof(chip8_instance_t));
+    if (!instance) return NULL;
+
+    instance->machine.seed = seed;
+    instance->insts_per_sec = insts_per_sec;
+    return instance;
+}
+
+/**
+ * Free an instance
+ * @param instance Instance
+*/
+void destroy_chip8(chip8_instance_t *instance) {
+    free(instance);
+}
+
+/**
+ * Load a ROM from memory and reset the machine to it; the ROM is copied, so
+ * the buffer can be freed right after
+ * @param instance Instance
+ * @param rom ROM bytes
+ * @param size ROM size in bytes
+ * @return Whether the ROM fits, the previous ROM stays loaded if not
+*/
+bool load_chip8_rom(chip8_instance_t *instance, const uint8_t *rom, size_t size) {
+    if (!load_rom_buffer(&instance->machine, rom, size)) return false;
+
+    instance->loaded = true;
+    reset_chip8(instance);
+    return true;
+}
+
+/**
+ * Reset the machine to the loaded ROM, restarting its random sequence; held keys stay held
+ * @param instance Instance
+*/
+void reset_chip8(chip8_instance_t *instance) {
+    if (!instance->loaded) return;
+
+    reset_emulator(&instance->machine);
+    instance->frame = 0;
+    instance->input = false;
+}
+
+/**
+ * Run frames at the instance's speed, each followed by a timer tick. Frames
+ * blocked on a key or spinning in an idle loop are fast-forwarded, keeping the
+ * loop's phase so keys set later land where they would with every frame run
+ * @param instance Instance
+ * @param frames Number of frames
+ * @return Frames that ran; the rest found the machine waiting for input with
+ * both timers stopped
+*/
+uint32_t step_chip8(chip8_instance_t *instance, uint32_t frames) {
+    if (!instance->loaded) return 0;
+
+    uint32_t ran = 0;
+    for (uint32_t f = 0; f < frames; f++, instance->frame++) {
+        const uint32_t insts = frame_budget(instance->insts_per_sec, instance->frame);
+        ran += advance_frame(&instance->machine, insts, instance->input);
+        instance->input = false;
+    }
+
+    return ran;
+}
+
+/**
+ * Set which keys are held from the next frame on
+ * @param instance Instance
+ * @param keys Bit k set while key k is held
+*/
+void set_chip8_keys(chip8_instance_t *instance, uint16_t keys) {
+    for (uint32_t key = 0; key < 16; key++) {
+        const bool down = keys >> key & 1;
+        instance->input |= instance->machine.keypad[key] != down;
+        instance->machine.keypad[key] = down;
+    }
+}
+
+/**
+ * Get the framebuffer, updated in place by every step
+ * @param instance Instance
+ * @return LIBCHIP8_HEIGHT rows, valid until the instance is destroyed
+*/
+const uint64_t *get_chip8_framebuffer(const chip8_instance_t *instance) {
+    return instance->machine.display;
+}
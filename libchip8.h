@@ -0,0 +1,54 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+// Bumped whenever a function below changes signature or meaning
+#define LIBCHIP8_ABI_VERSION 1
+
+// Framebuffer rows are packed one per word, with pixel 0 in the MSB
+#define LIBCHIP8_WIDTH 64
+#define LIBCHIP8_HEIGHT 32
+
+#if defined(__GNUC__)
+#define LIBCHIP8_API __attribute__((visibility("default")))
+#else
+#define LIBCHIP8_API
+#endif
+
+// Types
+typedef struct chip8_instance chip8_instance_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+LIBCHIP8_API uint32_t get_chip8_abi_version(void);
+LIBCHIP8_API chip8_instance_t *create_chip8(uint32_t insts_per_sec, uint64_t seed);
+LIBCHIP8_API void destroy_chip8(chip8_instance_t *instance);
+LIBCHIP8_API bool load_chip8_rom(chip8_instance_t *instance, const uint8_t *rom, size_t size);
+LIBCHIP8_API void reset_chip8(chip8_instance_t *instance);
+LIBCHIP8_API uint32_t step_chip8(chip8_instance_t *instance, uint32_t frames);
+LIBCHIP8_API void set_chip8_keys(chip8_instance_t *instance, uint16_t keys);
+LIBCHIP8_API const uint64_t *get_chip8_framebuffer(const chip8_instance_t *instance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
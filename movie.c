@@ -0,0 +1,207 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+#include "snapshot.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+// A movie is either being recorded to file or fully loaded into events
+struct movie {
+    FILE *file;
+    const char *name;
+    movie_header_t header;
+    movie_event_t *events;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                   HASHING                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Hash bytes using 64-bit FNV-1a
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @return Hash
+*/
+uint64_t hash_bytes(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Hash the whole machine state, as a snapshot would hold it
+ * @param chip8 Machine instance
+ * @return Hash
+*/
+uint64_t hash_machine(const chip8_t *chip8) {
+    snapshot_t snapshot;
+    save_snapshot(chip8, &snapshot);
+    return hash_bytes(&snapshot, sizeof(snapshot));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  RECORDING                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Start recording a movie of a freshly initialized machine
+ * @param name File name
+ * @param chip8 Machine instance, right after init_emulator
+ * @param insts_per_sec Instructions per second the recording runs at
+ * @param slices Input slices per frame the recording runs at
+ * @return Movie, NULL if the file could not be written
+*/
+movie_t *create_movie(const char *name, const chip8_t *chip8, uint32_t insts_per_sec, uint32_t slices) {
+    movie_t *movie = calloc(1, sizeof(movie_t));
+    if (!movie) return NULL;
+
+    memcpy(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic));
+    movie->header.version = MOVIE_VERSION;
+    movie->header.seed = chip8->seed;
+    movie->header.rom_hash = hash_bytes(chip8->memory, sizeof(chip8->memory));
+    movie->header.insts_per_sec = insts_per_sec;
+    movie->header.slices = slices;
+    movie->name = name;
+
+    // The header is written again with the totals by finish_movie
+    movie->file = fopen(name, "wb");
+    if (!movie->file || fwrite(&movie->header, sizeof(movie_header_t), 1, movie->file) != 1) {
+        fprintf(stderr, "[ERROR] Unable to write movie '%s'\n", name);
+        destroy_movie(movie);
+        return NULL;
+    }
+
+    return movie;
+}
+
+/**
+ * Append an event to a movie being recorded; write errors show up in finish_movie
+ * @param movie Movie
+ * @param type Event type
+ * @param frame Frames completed
+ * @param inst Instructions completed
+ * @param value Key or machine hash
+*/
+void record_movie_event(movie_t *movie, movie_event_type_t type, uint64_t frame, uint64_t inst, uint64_t value) {
+    const movie_event_t event = {
+        .frame = frame,
+        .inst = inst,
+        .value = value,
+        .type = type,
+    };
+
+    fwrite(&event, sizeof(event), 1, movie->file);
+    movie->header.events++;
+}
+
+/**
+ * Stop recording, write the totals into the header and free the movie
+ * @param movie Movie
+ * @param frames Frames completed
+ * @param chip8 Machine instance at the end of the recording
+ * @return Whether the whole movie was written
+*/
+bool finish_movie(movie_t *movie, uint64_t frames, const chip8_t *chip8) {
+    movie->header.frames = frames;
+    movie->header.final_hash = hash_machine(chip8);
+
+    bool written = !ferror(movie->file) && fseek(movie->file, 0, SEEK_SET) == 0 &&
+        fwrite(&movie->header, sizeof(movie_header_t), 1, movie->file) == 1;
+    written &= fclose(movie->file) == 0;
+    movie->file = NULL;
+
+    if (!written) fprintf(stderr, "[ERROR] Unable to write movie '%s'\n", movie->name);
+    destroy_movie(movie);
+    return written;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  PLAYBACK                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Load a recorded movie
+ * @param name File name
+ * @return Movie, NULL if missing or not a valid movie
+*/
+movie_t *open_movie(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        fprintf(stderr, "[ERROR] Movie '%s' not found\n", name);
+        return NULL;
+    }
+
+    movie_t *movie = calloc(1, sizeof(movie_t));
+    bool valid = movie && fread(&movie->header, sizeof(movie_header_t), 1, f) == 1 &&
+        memcmp(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic)) == 0 &&
+        movie->header.version == MOVIE_VERSION && movie->header.insts_per_sec != 0 &&
+        movie->header.slices != 0 && movie->header.events <= SIZE_MAX / sizeof(movie_event_t);
+
+    if (valid) {
+        const size_t count = movie->header.events;
+        movie->events = malloc(count ? count * sizeof(movie_event_t) : 1);
+        valid = movie->events && fread(movie->events, sizeof(movie_event_t), count, f) == count;
+    }
+    fclose(f);
+
+    if (!valid && movie && memcmp(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic)) == 0 &&
+        movie->header.version != MOVIE_VERSION) {
+        fprintf(stderr, "[ERROR] Movie '%s' has format version %u, expected %u\n", name, movie->header.version, MOVIE_VERSION);
+        destroy_movie(movie);
+        return NULL;
+    }
+    if (!valid) {
+        fprintf(stderr, "[ERROR] '%s' is not a valid movie\n", name);
+        destroy_movie(movie);
+        return NULL;
+    }
+
+    movie->name = name;
+    return movie;
+}
+
+/**
+ * Get the header of a loaded movie
+ * @param movie Movie
+ * @return Header
+*/
+const movie_header_t *get_movie_header(const movie_t *movie) {
+    return &movie->header;
+}
+
+/**
+ * Get the events of a loaded movie, in the order they were recorded
+ * @param movie Movie
+ * @return Events, header->events of them
+*/
+const movie_event_t *get_movie_events(const movie_t *movie) {
+    return movie->events;
+}
+
+/**
+ * Free a movie, closing it if still recording
+ * @param movie Movie
+*/
+void destroy_movie(movie_t *movie) {
+    if (!movie) return;
+
+    if (movie->file) fclose(movie->file);
+    free(movie->events);
+    free(movie);
+}
@@ -0,0 +1,71 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 2
+#define MOVIE_CHECKPOINT_INTERVAL CHIP8_FRAME_RATE
+
+// Types
+typedef enum {
+    MOVIE_KEY_DOWN,
+    MOVIE_KEY_UP,
+    MOVIE_RESET,
+    MOVIE_WAKE,      // Command that left the machine alone but still counted as input
+    MOVIE_CHECKPOINT // Machine hash, checked by replays
+} movie_event_type_t;
+
+// Events are stamped with the frames and instructions completed when they happened;
+// input lands at the start of a frame or, in sliced recordings, of one of its slices
+typedef struct {
+    uint64_t frame;
+    uint64_t inst;
+    uint64_t value; // Key for key events, machine hash for checkpoints
+    uint32_t type;
+    uint32_t reserved;
+} movie_event_t;
+
+// Native byte order; the header is rewritten with the totals once recording ends
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t seed;
+    uint64_t rom_hash;   // Memory right after loading the ROM
+    uint64_t frames;
+    uint64_t final_hash; // Machine hash after the last frame
+    uint64_t events;
+    uint32_t insts_per_sec;
+    uint32_t slices;     // Input slices per frame
+} movie_header_t;
+
+typedef struct movie movie_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+uint64_t hash_bytes(const void *data, size_t size);
+uint64_t hash_machine(const chip8_t *chip8);
+movie_t *create_movie(const char *name, const chip8_t *chip8, uint32_t insts_per_sec, uint32_t slices);
+void record_movie_event(movie_t *movie, movie_event_type_t type, uint64_t frame, uint64_t inst, uint64_t value);
+bool finish_movie(movie_t *movie, uint64_t frames, const chip8_t *chip8);
+movie_t *open_movie(const char *name);
+const movie_header_t *get_movie_header(const movie_t *movie);
+const movie_event_t *get_movie_events(const movie_t *movie);
+void destroy_movie(movie_t *movie);
+
+#endif
@@ -0,0 +1,223 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+const size_t pool_chunk_size = 16;
+
+// Types
+struct pool {
+    pthread_t *threads;
+    uint32_t thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    bool quit;
+
+    // Current job
+    uint64_t generation;
+    pool_task_t task;
+    void *arg;
+    size_t count;
+    size_t chunk;
+    size_t next;
+    size_t finished;
+};
+
+// Arguments of run_pool's task
+typedef struct {
+    chip8_t *machines;
+    uint64_t frames;
+    uint32_t insts_per_sec;
+} pool_frames_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                    POOL                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Worker thread loop; claims chunks of tasks and runs them to completion
+ * @param arg Pool
+ * @return Unused
+*/
+void *pool_worker(void *arg) {
+    pool_t *pool = arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        // Wait for a new job or shutdown
+        while (!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->quit) break;
+        seen = pool->generation;
+
+        // Claim chunks until the job is exhausted
+        while (pool->next < pool->count) {
+            const size_t start = pool->next;
+            const size_t end = start + pool->chunk < pool->count ? start + pool->chunk : pool->count;
+            pool->next = end;
+            pthread_mutex_unlock(&pool->lock);
+
+            for (size_t i = start; i < end; i++) pool->task(pool->arg, i);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->finished += end - start;
+            if (pool->finished == pool->count) pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Run one machine of a run_pool job for the job's frames
+ * @param arg Job arguments
+ * @param index Machine index
+*/
+void run_machine_frames(void *arg, size_t index) {
+    const pool_frames_t *job = arg;
+    chip8_t *machine = &job->machines[index];
+
+    for (uint64_t f = 0; f < job->frames; f++) {
+        emulate_frame(machine, frame_budget(job->insts_per_sec, f));
+
+        // Idle machines only have their timers left to run
+        if (can_skip_idle(machine)) {
+            const uint64_t start = (f + 1) * job->insts_per_sec / CHIP8_FRAME_RATE;
+            const uint64_t end = job->frames * job->insts_per_sec / CHIP8_FRAME_RATE;
+            skip_idle_frames(machine, job->frames - f - 1, end - start);
+            break;
+        }
+
+        // Loops waiting on DT skip ahead to the frame that may leave them
+        uint64_t wait = count_dt_wait(machine);
+        if (wait > job->frames - f - 1) wait = job->frames - f - 1;
+        if (wait > 0) {
+            const uint64_t start = (f + 1) * job->insts_per_sec / CHIP8_FRAME_RATE;
+            const uint64_t end = (f + 1 + wait) * job->insts_per_sec / CHIP8_FRAME_RATE;
+            skip_dt_wait(machine, wait, end - start);
+            f += wait;
+        }
+    }
+}
+
+/**
+ * Create a pool of worker threads
+ * @param threads Number of threads, or 0 for one per online core
+ * @return Pool, or NULL on failure
+*/
+pool_t *create_pool(uint32_t threads) {
+    if (threads == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (uint32_t)cores : 1;
+    }
+
+    pool_t *pool = calloc(1, sizeof(pool_t));
+    if (!pool) return NULL;
+
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            fprintf(stderr, "[ERROR] Unable to create worker thread\n");
+            destroy_pool(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+/**
+ * Run a task for every index across the workers, blocking until all are done
+ * @param pool Pool
+ * @param count Number of tasks
+ * @param chunk Tasks claimed at once; 1 for long tasks, more for short ones
+ * @param task Task, called from worker threads
+ * @param arg Passed to every task
+*/
+void run_pool_tasks(pool_t *pool, size_t count, size_t chunk, pool_task_t task, void *arg) {
+    if (count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->count = count;
+    pool->chunk = chunk > 0 ? chunk : 1;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+
+    while (pool->finished < pool->count) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Run a number of frames on every machine, blocking until all are done
+ * @param pool Pool
+ * @param machines Machine instances
+ * @param count Number of machines
+ * @param frames Number of frames per machine
+ * @param insts_per_sec Instructions per second
+*/
+void run_pool(pool_t *pool, chip8_t *machines, size_t count, uint64_t frames, uint32_t insts_per_sec) {
+    pool_frames_t job = {
+        .machines = machines,
+        .frames = frames,
+        .insts_per_sec = insts_per_sec,
+    };
+
+    run_pool_tasks(pool, count, pool_chunk_size, run_machine_frames, &job);
+}
+
+/**
+ * Stop worker threads and free the pool
+ * @param pool Pool
+*/
+void destroy_pool(pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_cond_destroy(&pool->job_done);
+    free(pool->threads);
+    free(pool);
+}
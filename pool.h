@@ -0,0 +1,30 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+typedef struct pool pool_t;
+typedef void (*pool_task_t)(void *arg, size_t index);
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+pool_t *create_pool(uint32_t threads);
+void run_pool_tasks(pool_t *pool, size_t count, size_t chunk, pool_task_t task, void *arg);
+void run_pool(pool_t *pool, chip8_t *machines, size_t count, uint64_t frames, uint32_t insts_per_sec);
+void destroy_pool(pool_t *pool);
+
+#endif
@@ -0,0 +1,375 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profile.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define PROFILE_MAX_NODES 1024
+#define PROFILE_GAP_BUCKETS 33
+
+// Types
+typedef enum {
+    CLASS_00E0, CLASS_00EE, CLASS_0NNN, CLASS_1NNN, CLASS_2NNN, CLASS_3XNN, CLASS_4XNN,
+    CLASS_5XY0, CLASS_6XNN, CLASS_7XNN, CLASS_8XY0, CLASS_8XY1, CLASS_8XY2, CLASS_8XY3,
+    CLASS_8XY4, CLASS_8XY5, CLASS_8XY6, CLASS_8XY7, CLASS_8XYE, CLASS_9XY0, CLASS_ANNN,
+    CLASS_BNNN, CLASS_CXNN, CLASS_DXYN, CLASS_EX9E, CLASS_EXA1, CLASS_FX07, CLASS_FX0A,
+    CLASS_FX15, CLASS_FX18, CLASS_FX1E, CLASS_FX29, CLASS_FX33, CLASS_FX55, CLASS_FX65,
+    CLASS_UNKNOWN,
+    CLASS_COUNT
+} opcode_class_t;
+
+// Call tree node, one per distinct chain of subroutine calls; node 0 is the
+// code reached from the entry point, so 0 also marks a missing child or sibling
+typedef struct {
+    uint16_t func;    // Subroutine entry address
+    uint16_t parent;
+    uint16_t child;   // First callee
+    uint16_t sibling; // Next callee of the same parent
+    uint64_t calls;
+    uint64_t self;    // Instructions run in the subroutine itself
+    uint64_t total;   // Instructions including callees, filled in on exit
+} node_t;
+
+typedef struct {
+    uint64_t insts;
+    uint64_t pcs[4096];
+    uint64_t classes[CLASS_COUNT];
+
+    // Instructions run between consecutive DXYN, bucketed by powers of two
+    uint64_t draws;
+    uint64_t last_draw;
+    uint64_t gap_min;
+    uint64_t gap_max;
+    uint64_t gap_sum;
+    uint64_t gaps[PROFILE_GAP_BUCKETS];
+
+    // Calls made once the tree is full are charged to the deepest tracked node
+    node_t nodes[PROFILE_MAX_NODES];
+    uint16_t node_count;
+    uint16_t current;
+    uint32_t untracked;
+    uint64_t dropped_calls;
+} profile_t;
+
+const char *class_names[CLASS_COUNT] = {
+    "00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN",
+    "5XY0", "6XNN", "7XNN", "8XY0", "8XY1", "8XY2", "8XY3",
+    "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0", "ANNN",
+    "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07", "FX0A",
+    "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+    "????",
+};
+
+// All counters are preallocated so recording never allocates
+profile_t profile = {
+    .gap_min = UINT64_MAX,
+    .nodes = {{ .func = CHIP8_ENTRY_POINT }},
+    .node_count = 1,
+};
+
+// Counters ordered by sort_counts
+const uint64_t *sort_keys = NULL;
+
+/* -------------------------------------------------------------------------- */
+/*                                  RECORDING                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Map an opcode to its instruction class, matching decode_instruction
+ * @param opcode Instruction opcode
+ * @return Instruction class
+*/
+opcode_class_t classify_opcode(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0:
+            if ((opcode & 0xFF) == 0xE0) return CLASS_00E0;
+            if ((opcode & 0xFF) == 0xEE) return CLASS_00EE;
+            return CLASS_0NNN;
+
+        case 0x8:
+            if ((opcode & 0xF) == 0xE) return CLASS_8XYE;
+            if ((opcode & 0xF) <= 0x7) return CLASS_8XY0 + (opcode & 0xF);
+            return CLASS_UNKNOWN;
+
+        case 0xE:
+            if ((opcode & 0xFF) == 0x9E) return CLASS_EX9E;
+            if ((opcode & 0xFF) == 0xA1) return CLASS_EXA1;
+            return CLASS_UNKNOWN;
+
+        case 0xF:
+            switch (opcode & 0xFF) {
+                case 0x07: return CLASS_FX07;
+                case 0x0A: return CLASS_FX0A;
+                case 0x15: return CLASS_FX15;
+                case 0x18: return CLASS_FX18;
+                case 0x1E: return CLASS_FX1E;
+                case 0x29: return CLASS_FX29;
+                case 0x33: return CLASS_FX33;
+                case 0x55: return CLASS_FX55;
+                case 0x65: return CLASS_FX65;
+                default: return CLASS_UNKNOWN;
+            }
+
+        case 0x9: return CLASS_9XY0;
+        case 0xA: return CLASS_ANNN;
+        case 0xB: return CLASS_BNNN;
+        case 0xC: return CLASS_CXNN;
+        case 0xD: return CLASS_DXYN;
+        default: return CLASS_1NNN + (opcode >> 12) - 0x1;
+    }
+}
+
+/**
+ * Descend into the call tree node of a subroutine called from the current one
+ * @param func Subroutine entry address
+*/
+void enter_subroutine(uint16_t func) {
+    if (profile.untracked) {
+        profile.untracked++;
+        profile.dropped_calls++;
+        return;
+    }
+
+    node_t *node = &profile.nodes[profile.current];
+    uint16_t child = node->child;
+    while (child && profile.nodes[child].func != func) child = profile.nodes[child].sibling;
+
+    if (!child) {
+        if (profile.node_count == PROFILE_MAX_NODES) {
+            profile.untracked = 1;
+            profile.dropped_calls++;
+            return;
+        }
+
+        child = profile.node_count++;
+        profile.nodes[child] = (node_t){ .func = func, .parent = profile.current, .sibling = node->child };
+        node->child = child;
+    }
+
+    profile.nodes[child].calls++;
+    profile.current = child;
+}
+
+/**
+ * Return to the caller's call tree node
+*/
+void leave_subroutine() {
+    if (profile.untracked) profile.untracked--;
+    else if (profile.current != 0) profile.current = profile.nodes[profile.current].parent;
+}
+
+/**
+ * Count one instruction about to run
+ * @param pc Address of the instruction
+ * @param opcode Instruction opcode
+*/
+void profile_instruction(uint16_t pc, uint16_t opcode) {
+    const opcode_class_t class = classify_opcode(opcode);
+    profile.pcs[pc & 0xFFF]++;
+    profile.classes[class]++;
+    profile.nodes[profile.current].self++;
+
+    if (class == CLASS_DXYN) {
+        if (profile.draws) {
+            const uint64_t gap = profile.insts - profile.last_draw - 1;
+            uint32_t bucket = gap ? 64 - __builtin_clzll(gap) : 0;
+            if (bucket >= PROFILE_GAP_BUCKETS) bucket = PROFILE_GAP_BUCKETS - 1;
+
+            profile.gaps[bucket]++;
+            profile.gap_sum += gap;
+            if (gap < profile.gap_min) profile.gap_min = gap;
+            if (gap > profile.gap_max) profile.gap_max = gap;
+        }
+        profile.last_draw = profile.insts;
+        profile.draws++;
+    } else if (class == CLASS_2NNN) {
+        enter_subroutine(opcode & 0x0FFF);
+    } else if (class == CLASS_00EE) {
+        leave_subroutine();
+    }
+
+    profile.insts++;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  REPORTING                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * qsort comparator ordering indices by descending sort_keys, then ascending index
+ * @param a First index
+ * @param b Second index
+ * @return Comparison result
+*/
+int sort_counts(const void *a, const void *b) {
+    const uint16_t i = *(const uint16_t *)a;
+    const uint16_t j = *(const uint16_t *)b;
+    if (sort_keys[i] != sort_keys[j]) return sort_keys[i] < sort_keys[j] ? 1 : -1;
+    return (i > j) - (i < j);
+}
+
+/**
+ * Collect the indices of non-zero counters, hottest first
+ * @param keys Counters
+ * @param count Number of counters
+ * @param order Output indices
+ * @return Number of indices written
+*/
+uint32_t sort_hot(const uint64_t *keys, uint32_t count, uint16_t *order) {
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (keys[i]) order[len++] = i;
+    }
+
+    sort_keys = keys;
+    qsort(order, len, sizeof(*order), sort_counts);
+    return len;
+}
+
+/**
+ * Share of all profiled instructions
+ * @param count Instruction count
+ * @return Percentage
+*/
+double percent(uint64_t count) {
+    return profile.insts ? 100.0 * count / profile.insts : 0.0;
+}
+
+/**
+ * Write the sorted hot-spot report
+ * @param chip8 Machine instance, for the opcodes at each address
+ * @param f Output file
+*/
+void write_report(const chip8_t *chip8, FILE *f) {
+    static uint16_t order[4096];
+    static uint64_t func_calls[4096], func_self[4096], func_total[4096];
+
+    fprintf(f, "Profile of '%s'\n", chip8->rom);
+    fprintf(f, "Instructions: %llu\n", (unsigned long long)profile.insts);
+
+    // Hot spots by address
+    fprintf(f, "\nHot spots\n");
+    fprintf(f, "%6s  %6s  %-5s %20s %8s\n", "PC", "Opcode", "Class", "Count", "%");
+    uint32_t len = sort_hot(profile.pcs, 4096, order);
+    for (uint32_t i = 0; i < len; i++) {
+        const uint16_t pc = order[i];
+        const uint16_t opcode = (chip8->memory[pc] << 8) | chip8->memory[(pc + 1) & 0xFFF];
+        fprintf(f, " 0x%03X  0x%04X  %-5s %20llu %8.2f\n", pc, opcode, class_names[classify_opcode(opcode)],
+                (unsigned long long)profile.pcs[pc], percent(profile.pcs[pc]));
+    }
+
+    // Opcode classes
+    fprintf(f, "\nOpcode classes\n");
+    fprintf(f, " %-5s %20s %8s\n", "Class", "Count", "%");
+    len = sort_hot(profile.classes, CLASS_COUNT, order);
+    for (uint32_t i = 0; i < len; i++) {
+        fprintf(f, " %-5s %20llu %8.2f\n", class_names[order[i]],
+                (unsigned long long)profile.classes[order[i]], percent(profile.classes[order[i]]));
+    }
+
+    // Instructions between draws
+    fprintf(f, "\nDraws\n");
+    fprintf(f, "DXYN executed: %llu\n", (unsigned long long)profile.draws);
+    if (profile.draws > 1) {
+        fprintf(f, "Instructions between draws: min %llu, avg %.1f, max %llu\n",
+                (unsigned long long)profile.gap_min, (double)profile.gap_sum / (profile.draws - 1),
+                (unsigned long long)profile.gap_max);
+
+        for (uint32_t i = 0; i < PROFILE_GAP_BUCKETS; i++) {
+            if (!profile.gaps[i]) continue;
+            const unsigned long long low = i ? 1ULL << (i - 1) : 0;
+            const unsigned long long high = i ? (1ULL << i) - 1 : 0;
+            if (i == PROFILE_GAP_BUCKETS - 1) fprintf(f, "  %10llu+           %20llu\n", low, (unsigned long long)profile.gaps[i]);
+            else fprintf(f, "  %10llu-%-10llu %20llu\n", low, high, (unsigned long long)profile.gaps[i]);
+        }
+    }
+
+    // Subroutines, merging every call chain that reaches them; recursive
+    // calls are left out of the totals so nothing is counted twice
+    for (uint32_t i = 0; i < profile.node_count; i++) profile.nodes[i].total = profile.nodes[i].self;
+    for (uint32_t i = profile.node_count - 1; i > 0; i--) {
+        profile.nodes[profile.nodes[i].parent].total += profile.nodes[i].total;
+    }
+
+    for (uint32_t i = 0; i < profile.node_count; i++) {
+        const node_t *node = &profile.nodes[i];
+        func_calls[node->func] += node->calls;
+        func_self[node->func] += node->self;
+
+        bool recursive = false;
+        for (uint32_t j = i; j != 0 && !recursive; ) {
+            j = profile.nodes[j].parent;
+            recursive = profile.nodes[j].func == node->func;
+        }
+        if (!recursive) func_total[node->func] += node->total;
+    }
+
+    fprintf(f, "\nSubroutines\n");
+    fprintf(f, "%6s %20s %20s %8s %20s %8s\n", "Entry", "Calls", "Self", "%", "Total", "%");
+    len = sort_hot(func_total, 4096, order);
+    for (uint32_t i = 0; i < len; i++) {
+        const uint16_t func = order[i];
+        fprintf(f, " 0x%03X %20llu %20llu %8.2f %20llu %8.2f\n", func, (unsigned long long)func_calls[func],
+                (unsigned long long)func_self[func], percent(func_self[func]),
+                (unsigned long long)func_total[func], percent(func_total[func]));
+    }
+
+    if (profile.dropped_calls) {
+        fprintf(f, "Calls past the call tree limit: %llu\n", (unsigned long long)profile.dropped_calls);
+    }
+}
+
+/**
+ * Write one folded stack line per call chain, as read by flamegraph tools
+ * @param f Output file
+*/
+void write_folded(FILE *f) {
+    static uint16_t path[PROFILE_MAX_NODES];
+
+    for (uint32_t i = 0; i < profile.node_count; i++) {
+        if (!profile.nodes[i].self) continue;
+
+        uint32_t depth = 0;
+        for (uint32_t j = i; j != 0; j = profile.nodes[j].parent) path[depth++] = j;
+
+        fprintf(f, "main");
+        while (depth--) fprintf(f, ";sub_0x%03X", profile.nodes[path[depth]].func);
+        fprintf(f, " %llu\n", (unsigned long long)profile.nodes[i].self);
+    }
+}
+
+/**
+ * Write the hot-spot report and the folded call stacks
+ * @param chip8 Machine instance
+ * @param report_name Report file name
+ * @param folded_name Folded stack file name
+ * @return Whether both files were written
+*/
+bool write_profile(const chip8_t *chip8, const char *report_name, const char *folded_name) {
+    FILE *report = fopen(report_name, "w");
+    if (!report) {
+        fprintf(stderr, "[ERROR] Unable to write profile '%s'\n", report_name);
+        return false;
+    }
+    write_report(chip8, report);
+    fclose(report);
+
+    FILE *folded = fopen(folded_name, "w");
+    if (!folded) {
+        fprintf(stderr, "[ERROR] Unable to write profile '%s'\n", folded_name);
+        return false;
+    }
+    write_folded(folded);
+    fclose(folded);
+
+    printf("[INFO] Profile written to '%s' and '%s'\n", report_name, folded_name);
+    return true;
+}
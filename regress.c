@@ -0,0 +1,619 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emulator.h"
+#include "jit.h"
+#include "movie.h"
+#include "pool.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define GOLDEN_MAGIC "chip8-golden"
+#define GOLDEN_VERSION 2
+#define REGRESS_PATH_SIZE 4096
+
+// Types
+typedef enum {
+    INTERPRETER,
+    JIT,
+    DIFF
+} engine_t;
+
+typedef enum {
+    RESULT_PASS,
+    RESULT_MISMATCH,
+    RESULT_NO_GOLDEN,
+    RESULT_UPDATED,
+    RESULT_ERROR
+} result_t;
+
+// Key change applied before the frame it is stamped with runs
+typedef struct {
+    uint64_t frame;
+    uint8_t key;
+    bool down;
+} input_t;
+
+// Hashes after a number of frames; the machine hash also catches changes
+// that have not reached the display yet, like a wrong flag
+typedef struct {
+    uint64_t frame;
+    uint64_t display;
+    uint64_t machine;
+} checkpoint_t;
+
+// Golden file: the speed and seed it was recorded with, then its checkpoints
+typedef struct {
+    uint32_t insts_per_sec;
+    uint64_t seed;
+    checkpoint_t *checkpoints;
+    size_t count;
+} golden_t;
+
+typedef struct {
+    char rom[REGRESS_PATH_SIZE];
+    const char *name; // ROM file name, within rom
+
+    result_t result;
+    const char *error;
+    double elapsed;
+    uint64_t frames;
+    size_t checkpoints;
+    size_t display_mismatches;
+    size_t machine_mismatches;
+    uint64_t first_mismatch; // Frame of the first mismatching checkpoint
+} job_t;
+
+// Config
+uint64_t frames = 600;
+uint64_t interval = CHIP8_FRAME_RATE;
+uint32_t insts_per_sec = 700;
+uint64_t seed = 0;
+uint32_t threads = 0;
+engine_t engine = INTERPRETER;
+bool update = false;
+const char *rom_dir = NULL;
+
+/* -------------------------------------------------------------------------- */
+/*                                   HELPERS                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get monotonic time in seconds
+ * @return Current time
+*/
+double get_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Build the path of a file that sits next to a ROM
+ * @param path Output buffer, REGRESS_PATH_SIZE bytes
+ * @param rom ROM path
+ * @param suffix Appended to the ROM path
+ * @return Whether the path fits
+*/
+bool sibling_path(char *path, const char *rom, const char *suffix) {
+    const int length = snprintf(path, REGRESS_PATH_SIZE, "%s%s", rom, suffix);
+    return length > 0 && length < REGRESS_PATH_SIZE;
+}
+
+/**
+ * Whether a file name is a ROM
+ * @param name File name
+ * @return Whether it ends in .ch8
+*/
+bool is_rom(const char *name) {
+    const size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".ch8") == 0;
+}
+
+/**
+ * Sort comparator for jobs, by ROM name
+ * @param a First job
+ * @param b Second job
+ * @return Ordering
+*/
+int compare_jobs(const void *a, const void *b) {
+    return strcmp(((const job_t *)a)->name, ((const job_t *)b)->name);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    FILES                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Load the scripted inputs of a ROM; one "FRAME +K" (press) or "FRAME -K"
+ * (release) per line, K a hex key, in frame order, with # starting a comment
+ * @param rom ROM path; inputs are read from ROM.input
+ * @param count Output number of inputs
+ * @param error Output error message
+ * @return Inputs, NULL on error; a ROM with no input file gets none
+*/
+input_t *load_inputs(const char *rom, size_t *count, const char **error) {
+    char path[REGRESS_PATH_SIZE];
+    *count = 0;
+    if (!sibling_path(path, rom, ".input")) {
+        *error = "Input path too long";
+        return NULL;
+    }
+
+    input_t *inputs = malloc(sizeof(input_t));
+    FILE *f = fopen(path, "r");
+    if (!inputs || !f) {
+        if (f) fclose(f);
+        if (!inputs) *error = "Out of memory";
+        return inputs;
+    }
+
+    size_t capacity = 1;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        unsigned long long frame;
+        char sign;
+        unsigned key;
+        if (sscanf(line, "%llu %c%x", &frame, &sign, &key) != 3 || (sign != '+' && sign != '-') || key > 0xF ||
+            (*count > 0 && frame < inputs[*count - 1].frame)) {
+            *error = "Invalid input file";
+            break;
+        }
+
+        if (*count == capacity) {
+            input_t *grown = realloc(inputs, 2 * capacity * sizeof(input_t));
+            if (!grown) {
+                *error = "Out of memory";
+                break;
+            }
+            inputs = grown;
+            capacity *= 2;
+        }
+        inputs[(*count)++] = (input_t){ .frame = frame, .key = key, .down = sign == '+' };
+    }
+    fclose(f);
+
+    if (*error) {
+        free(inputs);
+        return NULL;
+    }
+    return inputs;
+}
+
+/**
+ * Load the golden file of a ROM; a "chip8-golden VERSION INSTS_PER_SEC SEED ENGINE"
+ * line, then one "FRAME DISPLAY_HASH MACHINE_HASH" line per checkpoint, in frame order
+ * @param rom ROM path; the golden file is ROM.golden
+ * @param golden Output golden file
+ * @param error Output error message, left alone if the file is missing
+ * @return Whether the file was loaded
+*/
+bool load_golden(const char *rom, golden_t *golden, const char **error) {
+    char path[REGRESS_PATH_SIZE];
+    if (!sibling_path(path, rom, ".golden")) {
+        *error = "Golden path too long";
+        return false;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char magic[16];
+    unsigned version, speed;
+    unsigned long long golden_seed;
+    bool valid = fscanf(f, "%15s %u %u %llu", magic, &version, &speed, &golden_seed) == 4 &&
+        strcmp(magic, GOLDEN_MAGIC) == 0 && version == GOLDEN_VERSION && speed != 0;
+    golden->insts_per_sec = speed;
+    golden->seed = golden_seed;
+    golden->checkpoints = NULL;
+    golden->count = 0;
+
+    size_t capacity = 0;
+    unsigned long long frame, display, machine;
+    while (valid && fscanf(f, "%llu %llx %llx", &frame, &display, &machine) == 3) {
+        if (frame == 0 || (golden->count > 0 && frame <= golden->checkpoints[golden->count - 1].frame)) {
+            valid = false;
+            break;
+        }
+
+        if (golden->count == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            checkpoint_t *grown = realloc(golden->checkpoints, capacity * sizeof(checkpoint_t));
+            if (!grown) {
+                valid = false;
+                break;
+            }
+            golden->checkpoints = grown;
+        }
+        golden->checkpoints[golden->count++] = (checkpoint_t){ .frame = frame, .display = display, .machine = machine };
+    }
+
+    valid &= golden->count > 0 && feof(f);
+    fclose(f);
+
+    if (!valid) {
+        free(golden->checkpoints);
+        *error = "Invalid golden file";
+    }
+    return valid;
+}
+
+/**
+ * Write the golden file of a ROM
+ * @param rom ROM path; the golden file is ROM.golden
+ * @param golden Golden file
+ * @return Whether the whole file was written
+*/
+bool write_golden(const char *rom, const golden_t *golden) {
+    char path[REGRESS_PATH_SIZE];
+    if (!sibling_path(path, rom, ".golden")) return false;
+
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+
+    fprintf(f, "%s %u %u %llu\n", GOLDEN_MAGIC, GOLDEN_VERSION, golden->insts_per_sec,
+        (unsigned long long)golden->seed);
+    for (size_t i = 0; i < golden->count; i++) {
+        const checkpoint_t *checkpoint = &golden->checkpoints[i];
+        fprintf(f, "%llu %016llX %016llX\n", (unsigned long long)checkpoint->frame,
+            (unsigned long long)checkpoint->display, (unsigned long long)checkpoint->machine);
+    }
+
+    const bool written = !ferror(f);
+    return fclose(f) == 0 && written;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    JOBS                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Run a machine through its scripted inputs up to every checkpoint, storing
+ * the display and machine hashes at each
+ * @param machine Machine instance, freshly reset
+ * @param golden Checkpoints to fill in, and the speed to run at
+ * @param inputs Scripted inputs
+ * @param count Number of inputs
+*/
+void run_checkpoints(chip8_t *machine, golden_t *golden, const input_t *inputs, size_t count) {
+    uint64_t frame = 0;
+    size_t next = 0;
+
+    for (size_t c = 0; c < golden->count; c++) {
+        for (; frame < golden->checkpoints[c].frame; frame++) {
+            bool input = false;
+            for (; next < count && inputs[next].frame <= frame; next++) {
+                machine->keypad[inputs[next].key] = inputs[next].down;
+                input = true;
+            }
+
+            // Every frame counts, blocked or not, so idle loops have to keep their phase
+            advance_frame(machine, frame_budget(golden->insts_per_sec, frame), input);
+        }
+
+        golden->checkpoints[c].display = hash_bytes(machine->display, sizeof(machine->display));
+        golden->checkpoints[c].machine = hash_machine(machine);
+    }
+}
+
+/**
+ * Run one ROM of the corpus and check it against, or record, its golden file
+ * @param arg Jobs
+ * @param index Job index
+*/
+void run_job(void *arg, size_t index) {
+    job_t *job = &((job_t *)arg)[index];
+    const double start = get_time();
+
+    size_t input_count;
+    input_t *inputs = load_inputs(job->rom, &input_count, &job->error);
+    chip8_t *machine = calloc(1, sizeof(chip8_t));
+    golden_t expected = { 0 };
+    golden_t actual = { .insts_per_sec = insts_per_sec, .seed = seed };
+
+    // Checks replay the golden file's schedule; updates use the command line's
+    const bool has_golden = !job->error && !update && load_golden(job->rom, &expected, &job->error);
+    if (has_golden) {
+        actual.insts_per_sec = expected.insts_per_sec;
+        actual.seed = expected.seed;
+        actual.count = expected.count;
+    } else {
+        actual.count = (frames + interval - 1) / interval;
+    }
+
+    actual.checkpoints = calloc(actual.count, sizeof(checkpoint_t));
+    if (!job->error && (!machine || !actual.checkpoints)) job->error = "Out of memory";
+
+    if (!job->error) {
+        // Recorded checkpoints fall every interval frames, and on the last frame
+        for (size_t c = 0; c < actual.count; c++) {
+            const uint64_t frame = (c + 1) * interval < frames ? (c + 1) * interval : frames;
+            actual.checkpoints[c].frame = has_golden ? expected.checkpoints[c].frame : frame;
+        }
+
+        machine->seed = actual.seed;
+        if (!load_rom(machine, job->rom)) job->error = "Unable to load ROM";
+        else if (engine != INTERPRETER && !create_jit(machine, engine == DIFF)) job->error = "Unable to create JIT";
+    }
+
+    if (!job->error) {
+        reset_emulator(machine);
+        run_checkpoints(machine, &actual, inputs, input_count);
+        if (jit_diverged(machine)) job->error = "JIT diverged from the interpreter";
+        destroy_jit(machine);
+
+        job->frames = actual.checkpoints[actual.count - 1].frame;
+        job->checkpoints = actual.count;
+    }
+
+    if (job->error) {
+        job->result = RESULT_ERROR;
+    } else if (update) {
+        job->result = write_golden(job->rom, &actual) ? RESULT_UPDATED : RESULT_ERROR;
+        if (job->result == RESULT_ERROR) job->error = "Unable to write golden file";
+    } else if (!has_golden) {
+        job->result = RESULT_NO_GOLDEN;
+    } else {
+        for (size_t c = 0; c < actual.count; c++) {
+            const bool display = actual.checkpoints[c].display != expected.checkpoints[c].display;
+            const bool machine = actual.checkpoints[c].machine != expected.checkpoints[c].machine;
+            if ((display || machine) && !job->display_mismatches && !job->machine_mismatches) {
+                job->first_mismatch = actual.checkpoints[c].frame;
+            }
+            job->display_mismatches += display;
+            job->machine_mismatches += machine;
+        }
+        job->result = job->display_mismatches || job->machine_mismatches ? RESULT_MISMATCH : RESULT_PASS;
+    }
+
+    free(expected.checkpoints);
+    free(actual.checkpoints);
+    free(machine);
+    free(inputs);
+    job->elapsed = get_time() - start;
+}
+
+/**
+ * Collect the ROMs of the corpus directory as jobs, sorted by name
+ * @param count Output number of jobs
+ * @return Jobs, NULL on error or if there are none
+*/
+job_t *collect_jobs(size_t *count) {
+    DIR *dir = opendir(rom_dir);
+    if (!dir) {
+        fprintf(stderr, "[ERROR] Unable to open directory '%s'\n", rom_dir);
+        return NULL;
+    }
+
+    job_t *jobs = NULL;
+    size_t capacity = 0;
+    *count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!is_rom(entry->d_name)) continue;
+
+        if (*count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            job_t *grown = realloc(jobs, capacity * sizeof(job_t));
+            if (!grown) {
+                fprintf(stderr, "[ERROR] Unable to allocate jobs\n");
+                free(jobs);
+                closedir(dir);
+                return NULL;
+            }
+            jobs = grown;
+        }
+
+        job_t *job = &jobs[*count];
+        memset(job, 0, sizeof(job_t));
+        const int length = snprintf(job->rom, sizeof(job->rom), "%s/%s", rom_dir, entry->d_name);
+        if (length < 0 || length >= (int)sizeof(job->rom)) {
+            fprintf(stderr, "[ERROR] Path of '%s' is too long\n", entry->d_name);
+            continue;
+        }
+        job->name = job->rom + length - strlen(entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+
+    if (*count == 0) {
+        fprintf(stderr, "[ERROR] No ROMs found in '%s'\n", rom_dir);
+        free(jobs);
+        return NULL;
+    }
+
+    // Names point into their own job, so they move with it
+    qsort(jobs, *count, sizeof(job_t), compare_jobs);
+    for (size_t i = 0; i < *count; i++) jobs[i].name = strrchr(jobs[i].rom, '/') + 1;
+    return jobs;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   REPORT                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Print one job of the summary
+ * @param job Finished job
+*/
+void report(const job_t *job) {
+    printf("%-32s %10.3f ", job->name, job->elapsed * 1e3);
+
+    switch (job->result) {
+        case RESULT_PASS:
+            printf("PASS (%zu checkpoints, %llu frames)\n", job->checkpoints, (unsigned long long)job->frames);
+            break;
+
+        case RESULT_MISMATCH:
+            printf("MISMATCH (display %zu, machine %zu of %zu checkpoints, first at frame %llu)\n",
+                job->display_mismatches, job->machine_mismatches, job->checkpoints,
+                (unsigned long long)job->first_mismatch);
+            break;
+
+        case RESULT_NO_GOLDEN:
+            printf("NO GOLDEN (record one with -u)\n");
+            break;
+
+        case RESULT_UPDATED:
+            printf("UPDATED (%zu checkpoints, %llu frames)\n", job->checkpoints, (unsigned long long)job->frames);
+            break;
+
+        case RESULT_ERROR:
+            printf("ERROR (%s)\n", job->error);
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Parse command line arguments
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return Whether the run can go ahead
+*/
+bool set_config(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, ":n:k:i:S:j:e:uh")) != -1) {
+        switch (opt) {
+            case 'n':
+                // Frames to record
+                frames = strtoull(optarg, NULL, 10);
+                if (frames == 0) {
+                    fprintf(stderr, "[ERROR] Invalid frame count value\n");
+                    return false;
+                }
+                break;
+
+            case 'k':
+                // Frames between recorded checkpoints
+                interval = strtoull(optarg, NULL, 10);
+                if (interval == 0) {
+                    fprintf(stderr, "[ERROR] Invalid checkpoint interval value\n");
+                    return false;
+                }
+                break;
+
+            case 'i':
+                // Instructions per second to record at
+                insts_per_sec = (uint32_t)strtoul(optarg, NULL, 10);
+                if (insts_per_sec == 0) {
+                    fprintf(stderr, "[ERROR] Invalid instructions per second value\n");
+                    return false;
+                }
+                break;
+
+            case 'S':
+                // Random seed to record with
+                seed = strtoull(optarg, NULL, 10);
+                break;
+
+            case 'j':
+                // Worker thread count
+                threads = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'e':
+                // CPU engine
+                if (strcmp(optarg, "interpreter") == 0) engine = INTERPRETER;
+                else if (strcmp(optarg, "jit") == 0) engine = JIT;
+                else if (strcmp(optarg, "diff") == 0) engine = DIFF;
+                else {
+                    fprintf(stderr, "[ERROR] Invalid engine value\n");
+                    return false;
+                }
+                break;
+
+            case 'u':
+                // Record golden files instead of checking them
+                update = true;
+                break;
+
+            case 'h':
+                printf("Usage: %s [...OPTIONS] ROM_DIR\n", argv[0]);
+                printf("\n");
+                printf("Runs every ROM_DIR/*.ch8 with its scripted inputs from ROM.input, if any,\n");
+                printf("and checks its display and machine state at the checkpoints stored in ROM.golden\n");
+                printf("\n");
+                printf("Options:\n");
+                printf("  -u\tRecord golden files instead of checking them\n");
+                printf("  -n NUM\tSet frames to record (default: 600)\n");
+                printf("  -k NUM\tSet frames between recorded checkpoints (default: 60)\n");
+                printf("  -i NUM\tSet instructions per second to record at (default: 700)\n");
+                printf("  -S NUM\tSet random seed to record with (default: 0)\n");
+                printf("  -j NUM\tSet worker thread count (default: all cores)\n");
+                printf("  -e NAME\tSet CPU engine: interpreter, jit or diff (default: interpreter)\n");
+                printf("\n");
+                printf("Input lines are 'FRAME +K' or 'FRAME -K' to press or release hex key K\n");
+                printf("before frame FRAME runs; lines starting with # are ignored\n");
+                return false;
+
+            case ':':
+                fprintf(stderr, "[ERROR] Option requires a value\n");
+                return false;
+
+            case '?':
+                fprintf(stderr, "[ERROR] Unknown option\n");
+                return false;
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "[ERROR] Invalid number of args provided\n");
+        return false;
+    }
+    rom_dir = argv[optind];
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!set_config(argc, argv)) return EXIT_FAILURE;
+
+    size_t count;
+    job_t *jobs = collect_jobs(&count);
+    if (!jobs) return EXIT_FAILURE;
+
+    pool_t *pool = create_pool(threads);
+    if (!pool) {
+        free(jobs);
+        return EXIT_FAILURE;
+    }
+
+    // ROMs run for seconds at most, so workers claim them one at a time
+    const double start = get_time();
+    run_pool_tasks(pool, count, 1, run_job, jobs);
+    const double elapsed = get_time() - start;
+    destroy_pool(pool);
+
+    printf("%-32s %10s %s\n", "rom", "ms", "result");
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        report(&jobs[i]);
+        failed += jobs[i].result != RESULT_PASS && jobs[i].result != RESULT_UPDATED;
+    }
+
+    printf("[INFO] %zu ROMs, %zu failed, %.3f s\n", count, failed, elapsed);
+    free(jobs);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                  SNAPSHOT                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Copy the machine state into a snapshot
+ * @param chip8 Machine instance
+ * @param snapshot Output snapshot
+*/
+void save_snapshot(const chip8_t *chip8, snapshot_t *snapshot) {
+    memcpy(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic));
+    snapshot->version = SNAPSHOT_VERSION;
+    snapshot->size = sizeof(snapshot_t);
+    snapshot->reserved = 0;
+
+    memcpy(snapshot->display, chip8->display, sizeof(snapshot->display));
+    memcpy(snapshot->memory, chip8->memory, sizeof(snapshot->memory));
+    memcpy(snapshot->stack, chip8->stack, sizeof(snapshot->stack));
+    memcpy(snapshot->V, chip8->V, sizeof(snapshot->V));
+    snapshot->PC = chip8->PC;
+    snapshot->I = chip8->I;
+    snapshot->sp = chip8->sp;
+    snapshot->DT = chip8->DT;
+    snapshot->ST = chip8->ST;
+    snapshot->rng = chip8->rng;
+
+    for (uint32_t i = 0; i < 16; i++) snapshot->keypad[i] = chip8->keypad[i];
+    snapshot->key_pressed = chip8->key_pressed;
+    snapshot->key_wait = chip8->key_wait;
+    snapshot->key = chip8->key;
+    memset(snapshot->padding, 0, sizeof(snapshot->padding));
+}
+
+/**
+ * Check that a snapshot was written by this format version and holds nothing
+ * the emulator would index out of bounds with
+ * @param snapshot Snapshot
+ * @return Whether the snapshot can be restored
+*/
+bool check_snapshot(const snapshot_t *snapshot) {
+    return memcmp(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic)) == 0 &&
+        snapshot->version == SNAPSHOT_VERSION && snapshot->size == sizeof(snapshot_t) &&
+        snapshot->sp <= 16 && snapshot->key <= 0xF;
+}
+
+/**
+ * Put the machine back in a snapshot's state
+ * @param chip8 Machine instance
+ * @param snapshot Snapshot that passed check_snapshot
+*/
+void restore_snapshot(chip8_t *chip8, const snapshot_t *snapshot) {
+    memcpy(chip8->display, snapshot->display, sizeof(chip8->display));
+    memcpy(chip8->memory, snapshot->memory, sizeof(chip8->memory));
+    memcpy(chip8->stack, snapshot->stack, sizeof(chip8->stack));
+    memcpy(chip8->V, snapshot->V, sizeof(chip8->V));
+    chip8->PC = snapshot->PC;
+    chip8->I = snapshot->I;
+    chip8->sp = snapshot->sp;
+    chip8->DT = snapshot->DT;
+    chip8->ST = snapshot->ST;
+    chip8->rng = snapshot->rng;
+
+    for (uint32_t i = 0; i < 16; i++) chip8->keypad[i] = snapshot->keypad[i];
+    chip8->key_pressed = snapshot->key_pressed;
+    chip8->key_wait = snapshot->key_wait;
+    chip8->key = snapshot->key;
+
+    // All of memory may hold different code now
+    invalidate_decoded(chip8, 0, sizeof(chip8->memory));
+    chip8->idle.active = false;
+    chip8->draw_flag = true;
+}
+
+/**
+ * Write a snapshot to a file
+ * @param snapshot Snapshot
+ * @param name File name
+ * @return Whether the whole snapshot was written
+*/
+bool write_snapshot(const snapshot_t *snapshot, const char *name) {
+    FILE *f = fopen(name, "wb");
+    if (!f) {
+        fprintf(stderr, "[ERROR] Unable to write state '%s'\n", name);
+        return false;
+    }
+
+    const bool written = fwrite(snapshot, sizeof(*snapshot), 1, f) == 1;
+    if (fclose(f) != 0 || !written) {
+        fprintf(stderr, "[ERROR] Unable to write state '%s'\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Map a snapshot file read-only
+ * @param name File name
+ * @return Mapped snapshot, or NULL if missing or not a valid snapshot
+*/
+const snapshot_t *map_snapshot(const char *name) {
+    const int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "[ERROR] State '%s' not found\n", name);
+        return NULL;
+    }
+
+    void *map = (size_t)st.st_size == sizeof(snapshot_t) ? mmap(NULL, sizeof(snapshot_t), PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED || !check_snapshot(map)) {
+        if (map != MAP_FAILED) munmap(map, sizeof(snapshot_t));
+        fprintf(stderr, "[ERROR] '%s' is not a valid state\n", name);
+        return NULL;
+    }
+
+    return map;
+}
+
+/**
+ * Unmap a snapshot returned by map_snapshot
+ * @param snapshot Mapped snapshot
+*/
+void unmap_snapshot(const snapshot_t *snapshot) {
+    munmap((void *)snapshot, sizeof(snapshot_t));
+}
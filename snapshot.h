@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define SNAPSHOT_MAGIC "C8SS"
+#define SNAPSHOT_VERSION 2
+
+// Types
+// Same layout in memory and on disk (native byte order), so saved files can be mapped and read in place
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t rng;
+    uint64_t display[CHIP8_HEIGHT];
+    uint8_t memory[4096];
+    uint16_t stack[16];
+    uint16_t PC;
+    uint16_t I;
+    uint8_t V[16];
+    uint8_t keypad[16];
+    uint8_t sp;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t key_pressed;
+    uint8_t key_wait;
+    uint8_t key;
+    uint8_t padding[6];
+} snapshot_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+void save_snapshot(const chip8_t *chip8, snapshot_t *snapshot);
+bool check_snapshot(const snapshot_t *snapshot);
+void restore_snapshot(chip8_t *chip8, const snapshot_t *snapshot);
+bool write_snapshot(const snapshot_t *snapshot, const char *name);
+const snapshot_t *map_snapshot(const char *name);
+void unmap_snapshot(const snapshot_t *snapshot);
+
+#endif
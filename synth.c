@@ -0,0 +1,203 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "synth.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define SYNTH_RING_SIZE 256
+const uint32_t synth_frame_rate = 60;
+
+// Types
+typedef struct {
+    uint64_t time; // Producer clock, in samples
+    bool on;
+} edge_t;
+
+/*
+ * The emulator thread produces one frame of sound timer state at a time and
+ * the audio callback consumes it. They only share the edge ring, the producer
+ * clock and the counters, all accessed through atomics.
+*/
+struct synth {
+    // Shared
+    edge_t ring[SYNTH_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint64_t produced;
+    int16_t volume;
+    synth_stats_t stats;
+
+    // Producer only
+    uint64_t frames;
+    bool producer_on;
+
+    // Consumer only
+    uint32_t sample_rate;
+    uint32_t frame_samples;
+    uint32_t phase;
+    uint32_t phase_step;
+    uint64_t clock;
+    int64_t offset;
+    bool anchored;
+    bool on;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                    SYNTH                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Create a square wave synthesizer driven by sound timer edges
+ * @param sample_rate Output sample rate
+ * @param freq Tone frequency
+ * @param volume Initial amplitude
+ * @return Synthesizer, NULL on failure
+*/
+synth_t *create_synth(uint32_t sample_rate, uint32_t freq, int16_t volume) {
+    synth_t *synth = calloc(1, sizeof(synth_t));
+    if (!synth) return NULL;
+
+    synth->sample_rate = sample_rate;
+    synth->frame_samples = sample_rate / synth_frame_rate;
+    synth->phase_step = (uint32_t)(((uint64_t)freq << 32) / sample_rate);
+    synth->volume = volume;
+
+    return synth;
+}
+
+/**
+ * Free a synthesizer; the audio device must be closed first
+ * @param synth Synthesizer
+*/
+void destroy_synth(synth_t *synth) {
+    free(synth);
+}
+
+/**
+ * Record the sound timer state for one emulated frame (producer side)
+ * @param synth Synthesizer
+ * @param on Whether the tone plays during the frame
+*/
+void push_synth_frame(synth_t *synth, bool on) {
+    const uint64_t start = synth->frames * synth->sample_rate / synth_frame_rate;
+    synth->frames++;
+
+    if (on != synth->producer_on) {
+        const uint32_t head = __atomic_load_n(&synth->head, __ATOMIC_RELAXED);
+        const uint32_t tail = __atomic_load_n(&synth->tail, __ATOMIC_ACQUIRE);
+
+        if (head - tail < SYNTH_RING_SIZE) {
+            synth->ring[head % SYNTH_RING_SIZE] = (edge_t){ .time = start, .on = on };
+            __atomic_store_n(&synth->head, head + 1, __ATOMIC_RELEASE);
+            synth->producer_on = on;
+        } else {
+            // Retried next frame, since producer_on is left unchanged
+            __atomic_add_fetch(&synth->stats.dropped_edges, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Everything up to the end of this frame is now known
+    const uint64_t end = synth->frames * synth->sample_rate / synth_frame_rate;
+    __atomic_store_n(&synth->produced, end, __ATOMIC_RELEASE);
+}
+
+/**
+ * Fill an output buffer (consumer side, called from the audio callback)
+ * @param synth Synthesizer
+ * @param out Mono 16-bit samples
+ * @param count Number of samples
+*/
+void render_synth(synth_t *synth, int16_t *out, uint32_t count) {
+    const uint64_t produced = __atomic_load_n(&synth->produced, __ATOMIC_ACQUIRE);
+    const int16_t volume = __atomic_load_n(&synth->volume, __ATOMIC_RELAXED);
+    const uint64_t start = synth->clock;
+    const uint64_t end = start + count;
+    __atomic_add_fetch(&synth->stats.callbacks, 1, __ATOMIC_RELAXED);
+
+    /*
+     * Producer time maps to output time by a fixed offset, chosen so one
+     * emulated frame of state is buffered ahead. The emulator hands over
+     * whole frames, so less would starve between frames. Re-anchor when the
+     * producer stalls or runs too far ahead.
+    */
+    const int64_t margin = synth->frame_samples;
+    const int64_t known = (int64_t)produced + synth->offset;
+    if (!synth->anchored || known > (int64_t)end + 4 * margin) {
+        synth->offset = (int64_t)end - (int64_t)produced + margin;
+        synth->anchored = true;
+    } else if (known < (int64_t)end) {
+        __atomic_add_fetch(&synth->stats.underruns, 1, __ATOMIC_RELAXED);
+
+        // Producer stalled (paused or too slow): go silent and re-anchor when it resumes
+        if (known + margin < (int64_t)end) {
+            for (uint32_t i = 0; i < count; i++) out[i] = 0;
+            synth->anchored = false;
+            synth->clock = end;
+            return;
+        }
+    }
+
+    uint32_t tail = __atomic_load_n(&synth->tail, __ATOMIC_RELAXED);
+    const uint32_t head = __atomic_load_n(&synth->head, __ATOMIC_ACQUIRE);
+
+    uint32_t i = 0;
+    while (i < count) {
+        // Samples until the next edge, or the rest of the buffer
+        uint32_t run = count - i;
+        if (tail != head) {
+            const edge_t *edge = &synth->ring[tail % SYNTH_RING_SIZE];
+            const int64_t at = (int64_t)edge->time + synth->offset;
+
+            if (at <= (int64_t)(start + i)) {
+                if (at < (int64_t)start) __atomic_add_fetch(&synth->stats.late_edges, 1, __ATOMIC_RELAXED);
+                synth->on = edge->on;
+                tail++;
+                continue;
+            }
+            if (at < (int64_t)end) run = (uint32_t)(at - (int64_t)(start + i));
+        }
+
+        if (synth->on) {
+            for (uint32_t j = 0; j < run; j++) {
+                out[i + j] = (synth->phase & 0x80000000u) ? -volume : volume;
+                synth->phase += synth->phase_step;
+            }
+        } else {
+            for (uint32_t j = 0; j < run; j++) out[i + j] = 0;
+        }
+        i += run;
+    }
+
+    __atomic_store_n(&synth->tail, tail, __ATOMIC_RELEASE);
+    synth->clock = end;
+}
+
+/**
+ * Change the tone amplitude
+ * @param synth Synthesizer
+ * @param volume New amplitude
+*/
+void set_synth_volume(synth_t *synth, int16_t volume) {
+    __atomic_store_n(&synth->volume, volume, __ATOMIC_RELAXED);
+}
+
+/**
+ * Read the audio pipeline counters
+ * @param synth Synthesizer
+ * @param stats Destination for the counters
+*/
+void get_synth_stats(const synth_t *synth, synth_stats_t *stats) {
+    stats->callbacks = __atomic_load_n(&synth->stats.callbacks, __ATOMIC_RELAXED);
+    stats->underruns = __atomic_load_n(&synth->stats.underruns, __ATOMIC_RELAXED);
+    stats->late_edges = __atomic_load_n(&synth->stats.late_edges, __ATOMIC_RELAXED);
+    stats->dropped_edges = __atomic_load_n(&synth->stats.dropped_edges, __ATOMIC_RELAXED);
+}
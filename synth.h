@@ -0,0 +1,36 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Types
+typedef struct synth synth_t;
+
+typedef struct {
+    uint64_t callbacks;
+    uint64_t underruns;     // Buffers rendered past the last emulated frame
+    uint64_t late_edges;    // Edges that arrived after their sample was played
+    uint64_t dropped_edges; // Edges lost to a full ring
+} synth_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+synth_t *create_synth(uint32_t sample_rate, uint32_t freq, int16_t volume);
+void destroy_synth(synth_t *synth);
+void push_synth_frame(synth_t *synth, bool on);
+void render_synth(synth_t *synth, int16_t *out, uint32_t count);
+void set_synth_volume(synth_t *synth, int16_t volume);
+void get_synth_stats(const synth_t *synth, synth_stats_t *stats);
+
+#endif
@@ -0,0 +1,101 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Mapped trace file; records are written straight into the page cache, so
+// whatever ran before a crash is still in the file
+trace_header_t *trace_header = NULL;
+trace_record_t *trace_records = NULL;
+uint64_t trace_mask = 0;
+size_t trace_size = 0;
+const char *trace_file = NULL;
+
+/* -------------------------------------------------------------------------- */
+/*                                    TRACE                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Create the trace file and map it as a ring of records
+ * @param trace_name Trace file name
+ * @param capacity Number of records kept, a power of two
+ * @return Whether the trace file could be mapped
+*/
+bool open_trace(const char *trace_name, uint32_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1))) {
+        fprintf(stderr, "[ERROR] Trace capacity must be a power of two\n");
+        return false;
+    }
+
+    const int fd = open(trace_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[ERROR] Unable to create trace '%s'\n", trace_name);
+        return false;
+    }
+
+    const size_t size = sizeof(trace_header_t) + (size_t)capacity * sizeof(trace_record_t);
+    void *map = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[ERROR] Unable to map trace '%s'\n", trace_name);
+        return false;
+    }
+
+    trace_header = map;
+    *trace_header = (trace_header_t){
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(trace_record_t),
+        .capacity = capacity,
+    };
+    trace_records = (trace_record_t *)(trace_header + 1);
+    trace_mask = capacity - 1;
+    trace_size = size;
+    trace_file = trace_name;
+    return true;
+}
+
+/**
+ * Append the record of an instruction that has just run
+ * @param chip8 Machine instance
+ * @param pc Address of the instruction
+ * @param opcode Instruction opcode
+*/
+void trace_instruction(const chip8_t *chip8, uint16_t pc, uint16_t opcode) {
+    trace_records[trace_header->count & trace_mask] = (trace_record_t){
+        .pc = pc,
+        .opcode = opcode,
+        .I = chip8->I,
+        .vx = chip8->V[(opcode >> 8) & 0xF],
+        .vf = chip8->V[0xF],
+    };
+    trace_header->count++;
+}
+
+/**
+ * Unmap the trace file
+*/
+void close_trace() {
+    if (!trace_header) return;
+
+    const uint64_t count = trace_header->count;
+    const uint64_t kept = count < trace_mask + 1 ? count : trace_mask + 1;
+    printf("[INFO] Traced %llu instructions, last %llu kept in '%s'\n",
+        (unsigned long long)count, (unsigned long long)kept, trace_file);
+
+    munmap(trace_header, trace_size);
+    trace_header = NULL;
+    trace_records = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Constants
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+
+// Types
+// One executed instruction, with I, VX and VF as it left them
+typedef struct {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t vx;
+    uint8_t vf;
+} trace_record_t;
+
+// File header, followed by capacity records; record number n lives in slot n % capacity
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint64_t count;
+} trace_header_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                 PROTOTYPES                                 */
+/* -------------------------------------------------------------------------- */
+
+bool open_trace(const char *trace_name, uint32_t capacity);
+void trace_instruction(const chip8_t *chip8, uint16_t pc, uint16_t opcode);
+void close_trace();
+
+#endif
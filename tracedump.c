@@ -0,0 +1,243 @@
+/* -------------------------------------------------------------------------- */
+/*                                  INCLUDES                                  */
+/* -------------------------------------------------------------------------- */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                    DATA                                    */
+/* -------------------------------------------------------------------------- */
+
+// Config
+uint16_t pc_low = 0x000;
+uint16_t pc_high = 0xFFFF;
+uint16_t opcode_mask = 0x0000;
+uint16_t opcode_value = 0x0000;
+
+/* -------------------------------------------------------------------------- */
+/*                                   DECODER                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Parse an opcode pattern such as 8XY4 or FX0A; hex digits must match and
+ * any other character matches anything
+ * @param text Pattern text
+ * @return Whether the pattern is valid
+*/
+bool parse_pattern(const char *text) {
+    if (strlen(text) != 4) return false;
+
+    opcode_mask = 0;
+    opcode_value = 0;
+    for (int i = 0; i < 4; i++) {
+        const char c = text[i];
+        int digit = -1;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+
+        opcode_mask <<= 4;
+        opcode_value <<= 4;
+        if (digit >= 0) {
+            opcode_mask |= 0xF;
+            opcode_value |= digit;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Print a record as the debug build would have; values only known after the
+ * instruction ran are taken from the record that follows it
+ * @param r Record
+ * @param next Following record, NULL for the last one
+*/
+void print_record(const trace_record_t *r, const trace_record_t *next) {
+    const uint16_t NNN = r->opcode & 0x0FFF;
+    const uint8_t NN = r->opcode & 0x00FF;
+    const uint8_t N = r->opcode & 0x000F;
+    const uint8_t X = (r->opcode & 0x0F00) >> 8;
+    const uint8_t Y = (r->opcode & 0x00F0) >> 4;
+
+    // Outcome of a conditional skip, and where control went
+    const char *skip = !next ? "?" : next->pc == (uint16_t)(r->pc + 4) ? "1" : "0";
+    char target[8] = "0x????";
+    if (next) snprintf(target, sizeof(target), "0x%04X", next->pc);
+
+    // ALU flags are lost when the result itself went to VF
+    char flag[4] = "?";
+    if (X != 0xF) snprintf(flag, sizeof(flag), "%d", r->vf);
+
+    printf("[DEBUG] Opcode=0x%04X @ PC=0x%04X - ", r->opcode, r->pc);
+
+    switch (r->opcode >> 12) {
+        case 0x0:
+            if (NN == 0xE0) printf("Clear the screen\n");
+            else if (NN == 0xEE) printf("Return from subroutine to PC=%s\n", target);
+            else printf("Unimplemented opcode\n");
+            break;
+
+        case 0x1: printf("Jump to NNN=0x%03X\n", NNN); break;
+        case 0x2: printf("Call subroutine at NNN=0x%03X\n", NNN); break;
+        case 0x3: printf("Skip next instruction if V%01X equals NN=0x%02X (%d)\n", X, NN, r->vx == NN); break;
+        case 0x4: printf("Skip next instruction if V%01X doesn't equal NN=0x%02X (%d)\n", X, NN, r->vx != NN); break;
+        case 0x5: printf("Skip next instruction if V%01X equals V%01X (%s)\n", X, Y, skip); break;
+        case 0x6: printf("Set V%01X to NN=0x%02X\n", X, NN); break;
+        case 0x7: printf("Add NN=0x%02X to V%01X\n", NN, X); break;
+
+        case 0x8:
+            switch (N) {
+                case 0x0: printf("Set V%01X to V%01X\n", X, Y); break;
+                case 0x1: printf("Set V%01X to V%01X OR V%01X\n", X, X, Y); break;
+                case 0x2: printf("Set V%01X to V%01X AND V%01X\n", X, X, Y); break;
+                case 0x3: printf("Set V%01X to V%01X XOR V%01X\n", X, X, Y); break;
+                case 0x4: printf("Add V%01X to V%01X, set VF to %s\n", Y, X, flag); break;
+                case 0x5: printf("Subtract V%01X from V%01X, set VF to %s\n", Y, X, flag); break;
+                case 0x6: printf("Right-shift V%01X by 1, set VF to %s\n", X, flag); break;
+                case 0x7: printf("Set V%01X to V%01X - V%01X, set VF to %s\n", X, Y, X, flag); break;
+                case 0xE: printf("Left-shift V%01X by 1, set VF to %s\n", X, flag); break;
+                default: printf("Unimplemented opcode\n"); break;
+            }
+            break;
+
+        case 0x9: printf("Skip next instruction if V%01X doesn't equal V%01X (%s)\n", X, Y, skip); break;
+        case 0xA: printf("Set I to NNN=0x%03X\n", NNN); break;
+        case 0xB: printf("Jump to address NNN=0x%03X + V0 (%s)\n", NNN, target); break;
+
+        // The random number itself is not kept, only what ended up in VX
+        case 0xC: printf("Set VX to rand() AND NN=0x%02X (0x%02X)\n", NN, r->vx); break;
+        case 0xD: printf("Draw %u-height sprite at (V%01X, V%01X) from I 0x%04X\n", N, X, Y, r->I); break;
+
+        case 0xE:
+            if (NN == 0x9E) printf("Skip next instruction if key in V%01X is pressed (%s)\n", X, skip);
+            else if (NN == 0xA1) printf("Skip next instruction if key in V%01X isn't pressed (%s)\n", X, skip);
+            else printf("Unimplemented opcode\n");
+            break;
+
+        case 0xF:
+            switch (NN) {
+                case 0x07: printf("Set V%01X to DT=0x%02X\n", X, r->vx); break;
+                case 0x0A: printf("Wait for keypress and store it in V%01X\n", X); break;
+                case 0x15: printf("Set DT to V%01X\n", X); break;
+                case 0x18: printf("Set ST to V%01X\n", X); break;
+                case 0x1E: printf("Add V%01X to I=0x%04X\n", X, (uint16_t)(r->I - r->vx)); break;
+                case 0x29: printf("Set I to sprite adress in V%01X (0x%04X)\n", X, r->vx * 5); break;
+                case 0x33: printf("Store BCD representation of V%01X at I=%04X, I+1 and I+2\n", X, r->I); break;
+                case 0x55: printf("Store from V0 to V%01X in memory starting at I=0x%04X\n", X, r->I); break;
+                case 0x65: printf("Fill from V0 to V%01X from memory starting at I=0x%04X\n", X, r->I); break;
+                default: printf("Unimplemented opcode\n"); break;
+            }
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Application entry point
+ * @param argc Number of args
+ * @param argv Args list
+ * @return Exit code
+*/
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, ":p:o:h")) != -1) {
+        switch (opt) {
+            case 'p': {
+                // PC range
+                char *end;
+                pc_low = (uint16_t)strtoul(optarg, &end, 16);
+                pc_high = *end == '-' ? (uint16_t)strtoul(end + 1, &end, 16) : pc_low;
+                if (*end != '\0' || pc_low > pc_high) {
+                    fprintf(stderr, "[ERROR] Invalid PC range\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+
+            case 'o':
+                // Opcode pattern
+                if (!parse_pattern(optarg)) {
+                    fprintf(stderr, "[ERROR] Invalid opcode pattern\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'h':
+                printf("Usage: %s [...OPTIONS] TRACE_NAME\n", argv[0]);
+                printf("\n");
+                printf("Options:\n");
+                printf("  -p LOW-HIGH\tOnly show instructions at PCs in the hex range (default: 0000-FFFF)\n");
+                printf("  -o PATTERN\tOnly show opcodes matching PATTERN, e.g. DXYN or 8XY4\n");
+                return EXIT_SUCCESS;
+
+            case ':':
+                fprintf(stderr, "[ERROR] Option requires a value\n");
+                return EXIT_FAILURE;
+
+            case '?':
+                fprintf(stderr, "[ERROR] Unknown option\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "[ERROR] Invalid number of args provided\n");
+        return EXIT_FAILURE;
+    }
+
+    // Map the trace file
+    const char *trace_name = argv[optind];
+    const int fd = open(trace_name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "[ERROR] Trace '%s' not found\n", trace_name);
+        return EXIT_FAILURE;
+    }
+
+    const size_t size = st.st_size;
+    void *map = size >= sizeof(trace_header_t) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[ERROR] Unable to read trace '%s'\n", trace_name);
+        return EXIT_FAILURE;
+    }
+
+    const trace_header_t *header = map;
+    const trace_record_t *records = (const trace_record_t *)(header + 1);
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION ||
+        header->record_size != sizeof(trace_record_t) ||
+        size < sizeof(trace_header_t) + (size_t)header->capacity * sizeof(trace_record_t)) {
+        fprintf(stderr, "[ERROR] '%s' is not a trace file\n", trace_name);
+        munmap(map, size);
+        return EXIT_FAILURE;
+    }
+
+    // Oldest record still in the ring first
+    const uint64_t count = header->count;
+    const uint64_t first = count > header->capacity ? count - header->capacity : 0;
+    for (uint64_t n = first; n < count; n++) {
+        const trace_record_t *r = &records[n % header->capacity];
+        if (r->pc < pc_low || r->pc > pc_high || (r->opcode & opcode_mask) != opcode_value) continue;
+
+        print_record(r, n + 1 < count ? &records[(n + 1) % header->capacity] : NULL);
+    }
+
+    munmap(map, size);
+    return EXIT_SUCCESS;
+}